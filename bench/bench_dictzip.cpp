@@ -0,0 +1,223 @@
+/*
+ * .dict.dz read micro-benchmark: DictData::read, which inflates straight
+ * from the mapped file, against the former path that copied each chunk to
+ * a stack buffer, inflated it to a chunk buffer and copied the part asked
+ * for. Entries are read in file order and in random order, with no cache
+ * shared between reads besides the chunk read last.
+ *
+ * usage: bench_dictzip [megabytes]
+ * a made up dictionary of that many megabytes, 32 by default, is written
+ * to a temporary file.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include <zlib.h>
+
+#include "dictziplib.hpp"
+
+namespace {
+
+const unsigned chunk_length = 58315; // as dictzip makes them
+
+struct Entry {
+    unsigned long offset, size;
+};
+
+std::string make_data(size_t bytes, std::vector<Entry> &entries)
+{
+    static const char *const words[] = {
+        "the ", "of ", "word ", "dictionary ", "noun ", "verb ", "meaning ", "see ", "also ", "example ",
+        "<b>", "</b>", "<i>", "</i>", "\n", "pronunciation ", "plural ", "from ", "Latin ", "Greek ",
+    };
+    const size_t nwords = sizeof(words) / sizeof(words[0]);
+    std::mt19937 rng(42);
+    std::string data;
+    data.reserve(bytes + 256 * 1024);
+    while (data.size() < bytes) {
+        // mostly short entries, a few spanning whole chunks
+        const size_t size = rng() % 200 ? 50 + rng() % 3000 : 60000 + rng() % 150000;
+        Entry e{data.size(), 0};
+        while (data.size() - e.offset < size)
+            data += words[rng() % nwords];
+        e.size = data.size() - e.offset;
+        entries.push_back(e);
+    }
+    return data;
+}
+
+void put16(std::string &s, unsigned v)
+{
+    s += char(v & 0xff);
+    s += char(v >> 8);
+}
+
+void put32(std::string &s, unsigned long v)
+{
+    put16(s, v & 0xffff);
+    put16(s, (v >> 16) & 0xffff);
+}
+
+// writes data as a .dict.dz, chunks flushed one by one as dictzip does.
+bool write_dictzip(const std::string &data, const char *filename, std::vector<std::string> &chunks)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, 9, Z_DEFLATED, -15, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+    for (size_t off = 0; off < data.size(); off += chunk_length) {
+        const size_t len = std::min<size_t>(chunk_length, data.size() - off);
+        std::string out(deflateBound(&zs, len) + 64, '\0');
+        zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data() + off));
+        zs.avail_in = len;
+        zs.next_out = reinterpret_cast<Bytef *>(&out[0]);
+        zs.avail_out = out.size();
+        deflate(&zs, off + len < data.size() ? Z_FULL_FLUSH : Z_FINISH);
+        out.resize(out.size() - zs.avail_out);
+        chunks.push_back(out);
+    }
+    deflateEnd(&zs);
+
+    std::string sub;
+    put16(sub, 1);
+    put16(sub, chunk_length);
+    put16(sub, chunks.size());
+    for (const auto &c : chunks)
+        put16(sub, c.size());
+    std::string header("\x1f\x8b\x08\x04", 4);
+    put32(header, 0);
+    header += "\x02\x03";
+    put16(header, sub.size() + 4);
+    header += "RA";
+    put16(header, sub.size());
+    header += sub;
+
+    FILE *f = fopen(filename, "wb");
+    if (!f)
+        return false;
+    fwrite(header.data(), 1, header.size(), f);
+    for (const auto &c : chunks)
+        fwrite(c.data(), 1, c.size(), f);
+    std::string trailer;
+    put32(trailer, crc32(0, reinterpret_cast<const Bytef *>(data.data()), data.size()));
+    put32(trailer, data.size() & 0xffffffffUL);
+    fwrite(trailer.data(), 1, trailer.size(), f);
+    return fclose(f) == 0;
+}
+
+// the read path before: compressed chunk copied to the stack, inflated to
+// the chunk buffer, then copied to the entry.
+class CopyingReader {
+public:
+    explicit CopyingReader(const std::vector<std::string> &c)
+        : chunks(c)
+        , chunk_buffer(chunk_length, '\0')
+    {
+        memset(&zs, 0, sizeof(zs));
+        inflateInit2(&zs, -15);
+    }
+    ~CopyingReader() { inflateEnd(&zs); }
+
+    void read(char *buffer, unsigned long start, unsigned long size)
+    {
+        char in[0xffff];
+        const unsigned long end = start + size;
+        for (unsigned long i = start / chunk_length; i <= end / chunk_length; ++i) {
+            const unsigned long from = i == start / chunk_length ? start % chunk_length : 0;
+            const unsigned long to = i == end / chunk_length ? end % chunk_length : chunk_length;
+            if (to <= from)
+                continue;
+            if (long(i) != last) {
+                memcpy(in, chunks[i].data(), chunks[i].size());
+                inflateReset(&zs);
+                zs.next_in = reinterpret_cast<Bytef *>(in);
+                zs.avail_in = chunks[i].size();
+                zs.next_out = reinterpret_cast<Bytef *>(&chunk_buffer[0]);
+                zs.avail_out = chunk_buffer.size();
+                inflate(&zs, Z_PARTIAL_FLUSH);
+                last = i;
+            }
+            memcpy(buffer, chunk_buffer.data() + from, to - from);
+            buffer += to - from;
+        }
+    }
+
+private:
+    const std::vector<std::string> &chunks;
+    std::string chunk_buffer;
+    z_stream zs;
+    long last = -1;
+};
+
+double now_ms()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    const size_t mb = argc > 1 ? strtoul(argv[1], nullptr, 10) : 32;
+    std::vector<Entry> entries;
+    const std::string data = make_data(mb << 20, entries);
+
+    char filename[] = "/tmp/bench_dictzip_XXXXXX";
+    const int fd = mkstemp(filename);
+    if (fd < 0) {
+        perror("mkstemp");
+        return EXIT_FAILURE;
+    }
+    close(fd);
+    std::vector<std::string> chunks;
+    DictData dict;
+    const bool ok = write_dictzip(data, filename, chunks) && dict.open(filename, 0);
+    unlink(filename);
+    if (!ok) {
+        printf("cannot write or open %s\n", filename);
+        return EXIT_FAILURE;
+    }
+    printf("%zu entries, %.1f MB in %zu chunks\n", entries.size(), data.size() / 1e6, chunks.size());
+    printf("%-12s %12s %12s %10s\n", "order", "copying ms", "direct ms", "MB/s");
+
+    std::vector<Entry> random_entries(entries);
+    std::shuffle(random_entries.begin(), random_entries.end(), std::mt19937(7));
+    const struct {
+        const char *name;
+        const std::vector<Entry> &entries;
+    } orders[] = {
+        {"sequential", entries},
+        {"random", random_entries},
+    };
+    std::string a, b;
+    for (const auto &order : orders) {
+        CopyingReader copying(chunks);
+        DictReadContext ctx;
+        double copying_ms = 0, direct_ms = 0;
+        for (const Entry &e : order.entries) {
+            a.resize(e.size);
+            b.resize(e.size);
+            double t0 = now_ms();
+            copying.read(&a[0], e.offset, e.size);
+            double t1 = now_ms();
+            dict.read(ctx, &b[0], e.offset, e.size);
+            double t2 = now_ms();
+            copying_ms += t1 - t0;
+            direct_ms += t2 - t1;
+            if (a.compare(0, e.size, data, e.offset, e.size) || b.compare(0, e.size, data, e.offset, e.size)) {
+                printf("mismatch at %lu, %lu bytes\n", e.offset, e.size);
+                return EXIT_FAILURE;
+            }
+        }
+        printf("%-12s %12.2f %12.2f %10.1f\n", order.name, copying_ms, direct_ms, data.size() / 1e3 / direct_ms);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,125 @@
+/*
+ * Fuzzy search micro-benchmark: the matrix based EditDistance against the
+ * bit-parallel BitParallelDistance, scanning a word list the way
+ * Libs::LookupWithFuzzy does.
+ *
+ * usage: bench_distance [word-list-file]
+ * without a file 500000 made up words are used.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "distance.hpp"
+
+namespace {
+
+const int limit = 3; // MAX_FUZZY_DISTANCE
+
+const char *const queries[] = {
+    "recieve",
+    "acommodate",
+    "teh",
+    "definately",
+    "interntional",
+    "pronounciation",
+    // longer than a machine word
+    "pneumonoultramicroscopicsilicovolcanoconiosis-and-supercalifragilisticexpialidocious",
+};
+
+std::vector<std::string> make_words(size_t n)
+{
+    static const char *const syllables[] = {
+        "a", "an", "ar", "be", "ca", "ce", "ci", "co", "de", "di", "e", "en", "er", "ex", "fa", "fi",
+        "ga", "ge", "ha", "he", "i", "in", "is", "la", "le", "li", "lo", "ma", "me", "mi", "mo", "na",
+        "ne", "ni", "no", "o", "on", "or", "pa", "pe", "pi", "po", "ra", "re", "ri", "ro", "sa", "se",
+        "si", "so", "ta", "te", "ti", "to", "tion", "u", "un", "ur", "ve", "vi", "ing", "ed", "ly",
+    };
+    const size_t nsyl = sizeof(syllables) / sizeof(syllables[0]);
+    std::mt19937 rng(42);
+    std::vector<std::string> words(n);
+    for (auto &w : words) {
+        // a few long compounds for the patterns over 64 bytes
+        const int k = rng() % 1000 ? 1 + rng() % 5 : 30 + rng() % 10;
+        for (int i = 0; i < k; ++i)
+            w += syllables[rng() % nsyl];
+    }
+    return words;
+}
+
+// what LookupWithFuzzy compares: the lower case head as long as the query.
+std::vector<std::string> candidates(const std::vector<std::string> &words, const char *query)
+{
+    const int qlen = strlen(query);
+    std::vector<std::string> res;
+    for (const auto &w : words) {
+        const int len = w.size();
+        if (len - qlen >= limit || qlen - len >= limit)
+            continue;
+        res.emplace_back(w, 0, std::min(len, qlen));
+        for (auto &ch : res.back())
+            ch = tolower(ch);
+    }
+    return res;
+}
+
+double now_ms()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> words;
+    if (argc > 1) {
+        std::ifstream in(argv[1]);
+        std::string line;
+        while (std::getline(in, line))
+            if (!line.empty())
+                words.push_back(line);
+    } else {
+        words = make_words(500000);
+    }
+    printf("%zu words\n", words.size());
+    printf("%-24s %10s %12s %12s %8s\n", "query", "scanned", "matrix ms", "bitpar ms", "matches");
+
+    EditDistance matrix;
+    double total_matrix = 0, total_bitpar = 0;
+    for (const char *query : queries) {
+        const std::vector<std::string> cands = candidates(words, query);
+        std::vector<int> a(cands.size()), b(cands.size());
+
+        double t0 = now_ms();
+        for (size_t i = 0; i < cands.size(); ++i)
+            a[i] = matrix.CalEditDistance(cands[i].c_str(), query, limit);
+        double t1 = now_ms();
+        const BitParallelDistance bitpar(query);
+        for (size_t i = 0; i < cands.size(); ++i)
+            b[i] = bitpar.CalEditDistance(cands[i].data(), cands[i].size(), limit);
+        double t2 = now_ms();
+
+        int matches = 0;
+        for (size_t i = 0; i < cands.size(); ++i) {
+            if ((a[i] < limit) != (b[i] < limit) || (a[i] < limit && a[i] != b[i])) {
+                printf("mismatch: %s %s: %d %d\n", query, cands[i].c_str(), a[i], b[i]);
+                return EXIT_FAILURE;
+            }
+            matches += a[i] < limit;
+        }
+        printf("%-24.24s %10zu %12.2f %12.2f %8d\n", query, cands.size(), t1 - t0, t2 - t1, matches);
+        total_matrix += t1 - t0;
+        total_bitpar += t2 - t1;
+    }
+    printf("%-24s %10s %12.2f %12.2f\n", "total", "", total_matrix, total_bitpar);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,133 @@
+/*
+ * Wildcard query micro-benchmark: GlobPattern against the std::regex the
+ * wildcards used to be translated to, each matching every word of a
+ * lexicon the way Dict::LookupWithRule does without a literal prefix.
+ *
+ * usage: bench_glob [word-list-file]
+ * without a file 500000 made up words are used. '?' is one byte for the
+ * regex and one UTF-8 character for GlobPattern, so the two are only
+ * checked against each other on ASCII words.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "glob.hpp"
+
+namespace {
+
+const char *const patterns[] = {
+    "inter*tion",
+    "*tion",
+    "re*ed",
+    "?a*",
+    "*in*er*",
+    "un*able",
+    "co?e*",
+    "*ly",
+    "b??e",
+    "*a*e*i*o*",
+};
+
+std::vector<std::string> make_words(size_t n)
+{
+    static const char *const syllables[] = {
+        "a", "an", "ar", "be", "ca", "ce", "ci", "co", "de", "di", "e", "en", "er", "ex", "fa", "fi",
+        "ga", "ge", "ha", "he", "i", "in", "is", "la", "le", "li", "lo", "ma", "me", "mi", "mo", "na",
+        "ne", "ni", "no", "o", "on", "or", "pa", "pe", "pi", "po", "ra", "re", "ri", "ro", "sa", "se",
+        "si", "so", "ta", "te", "ti", "to", "tion", "u", "un", "ur", "ve", "vi", "ing", "ed", "ly",
+        "able", "Inter", "Re", "Co",
+    };
+    const size_t nsyl = sizeof(syllables) / sizeof(syllables[0]);
+    std::mt19937 rng(42);
+    std::vector<std::string> words(n);
+    for (auto &w : words)
+        for (int i = 1 + rng() % 5; i > 0; --i)
+            w += syllables[rng() % nsyl];
+    return words;
+}
+
+// the translation LookupWithRule used before GlobPattern had a matcher.
+std::regex glob_regex(const char *p)
+{
+    std::string res;
+    for (; *p; ++p) {
+        if (*p == '*' || *p == '?') {
+            res += *p == '*' ? ".*" : ".";
+            continue;
+        }
+        if (*p == '\\' && !*++p)
+            break;
+        if (strchr("\\^$.|+*?()[]{}", *p))
+            res += '\\';
+        res += *p;
+    }
+    return std::regex(res, std::regex::egrep | std::regex::icase | std::regex::nosubs);
+}
+
+bool is_ascii(const std::string &s)
+{
+    for (const char c : s)
+        if (c & 0x80)
+            return false;
+    return true;
+}
+
+double now_ms()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> words;
+    if (argc > 1) {
+        std::ifstream in(argv[1]);
+        std::string line;
+        while (std::getline(in, line))
+            if (!line.empty())
+                words.push_back(line);
+    } else {
+        words = make_words(500000);
+    }
+    printf("%zu words\n", words.size());
+    printf("%-16s %12s %12s %8s %8s\n", "pattern", "regex ms", "glob ms", "speedup", "matches");
+
+    std::vector<char> a(words.size()), b(words.size());
+    double total_regex = 0, total_glob = 0;
+    for (const char *pattern : patterns) {
+        const std::regex re = glob_regex(pattern);
+        double t0 = now_ms();
+        for (size_t i = 0; i < words.size(); ++i)
+            a[i] = std::regex_match(words[i].c_str(), re);
+        double t1 = now_ms();
+        const GlobPattern glob(pattern);
+        for (size_t i = 0; i < words.size(); ++i)
+            b[i] = glob.match(words[i].c_str());
+        double t2 = now_ms();
+
+        int matches = 0;
+        for (size_t i = 0; i < words.size(); ++i) {
+            if (a[i] != b[i] && is_ascii(words[i])) {
+                printf("mismatch: %s %s: %d %d\n", pattern, words[i].c_str(), a[i], b[i]);
+                return EXIT_FAILURE;
+            }
+            matches += b[i];
+        }
+        printf("%-16s %12.2f %12.2f %7.1fx %8d\n", pattern, t1 - t0, t2 - t1, (t1 - t0) / (t2 - t1), matches);
+        total_regex += t1 - t0;
+        total_glob += t2 - t1;
+    }
+    printf("%-16s %12.2f %12.2f %7.1fx\n", "total", total_regex, total_glob, total_regex / total_glob);
+
+    return EXIT_SUCCESS;
+}
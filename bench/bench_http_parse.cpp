@@ -0,0 +1,204 @@
+/*
+ * Request parsing micro-benchmark: the regex based parser httplib used
+ * before against the hand-written one in httplib::detail.
+ *
+ * usage: bench_http_parse [iterations]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "httplib.h"
+
+using namespace httplib;
+
+namespace {
+
+const char *const request_lines[] = {
+    "GET /neigh?w=inter&off=-2&len=10 HTTP/1.1\r\n",
+    "GET /?w=%E4%BD%A0%E5%A5%BD&co=1 HTTP/1.1\r\n",
+    "GET / HTTP/1.0\r\n",
+    "GET /html/jquery-ui.css HTTP/1.1\r\n",
+    "POST /form HTTP/1.1\r\n",
+    "HEAD /neigh?w=a+b HTTP/1.1\r\n",
+    // rejected ones
+    "GET /? HTTP/1.1\r\n",
+    "GET ?w=x HTTP/1.1\r\n",
+    "PUT / HTTP/1.1\r\n",
+    "GET / HTTP/2.0\r\n",
+    "GET / HTTP/1.1\n",
+};
+
+const char *const header_lines[] = {
+    "Host: 127.0.0.1:8888\r\n",
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/115.0\r\n",
+    "Accept: */*\r\n",
+    "Accept-Language: en-US,en;q=0.5\r\n",
+    "Accept-Encoding: gzip, deflate, br\r\n",
+    "Referer: http://127.0.0.1:8888/?w=inter\r\n",
+    "X-Requested-With: XMLHttpRequest\r\n",
+    "Connection: keep-alive\r\n",
+    // rejected ones
+    "no colon\r\n",
+    ": empty key\r\n",
+};
+
+const char *const paths[] = {
+    "/html/jquery-ui.css", "/html/jquery.js", "/out.htm", "/neigh", "/a.b/c", "/x.",
+};
+
+struct Parsed {
+    std::string method, path, version;
+    Params params;
+    bool operator==(const Parsed &o) const
+    {
+        return method == o.method && path == o.path && version == o.version && params == o.params;
+    }
+};
+
+bool regex_request_line(const char *s, Parsed &p)
+{
+    static std::regex re("(GET|HEAD|POST) ([^?]+)(?:\\?(.+?))? (HTTP/1\\.[01])\r\n");
+
+    std::cmatch m;
+    if (std::regex_match(s, m, re)) {
+        p.version = std::string(m[4]);
+        p.method = std::string(m[1]);
+        p.path = detail::decode_url(m[2]);
+        if (m[3].length() > 0) {
+            detail::parse_query_text(m[3], p.params);
+        }
+        return true;
+    }
+    return false;
+}
+
+bool plain_request_line(const char *s, Parsed &p)
+{
+    detail::request_line rl;
+    if (!detail::parse_request_line(s, s + strlen(s), rl)) {
+        return false;
+    }
+    p.version.assign(rl.version.b, rl.version.e);
+    p.method.assign(rl.method.b, rl.method.e);
+    p.path = detail::decode_url(rl.path.b, rl.path.e);
+    if (!rl.query.empty()) {
+        detail::parse_query_text(rl.query.b, rl.query.e, p.params);
+    }
+    return true;
+}
+
+bool regex_header(const char *s, Headers &headers)
+{
+    static std::regex re(R"((.+?):\s*(.+?)\s*\r\n)");
+
+    std::cmatch m;
+    if (std::regex_match(s, m, re)) {
+        headers.emplace(std::string(m[1]), std::string(m[2]));
+        return true;
+    }
+    return false;
+}
+
+bool plain_header(const char *s, Headers &headers)
+{
+    detail::string_ref key, val;
+    if (detail::parse_header(s, s + strlen(s), key, val)) {
+        headers.emplace(key.str(), val.str());
+        return true;
+    }
+    return false;
+}
+
+std::string regex_extension(const std::string &path)
+{
+    std::smatch m;
+    auto pat = std::regex("\\.([a-zA-Z0-9]+)$");
+    if (std::regex_search(path, m, pat)) {
+        return m[1].str();
+    }
+    return std::string();
+}
+
+bool check()
+{
+    bool ok = true;
+    for (const char *line : request_lines) {
+        Parsed a, b;
+        bool ra = regex_request_line(line, a), rb = plain_request_line(line, b);
+        if (ra != rb || !(a == b)) {
+            printf("request line mismatch: %s", line);
+            ok = false;
+        }
+    }
+    for (const char *line : header_lines) {
+        Headers a, b;
+        bool ra = regex_header(line, a), rb = plain_header(line, b);
+        if (ra != rb || a != b) {
+            printf("header mismatch: %s", line);
+            ok = false;
+        }
+    }
+    for (const char *path : paths) {
+        if (regex_extension(path) != detail::file_extension(path)) {
+            printf("extension mismatch: %s\n", path);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+template <typename F>
+double run(long iterations, F f)
+{
+    const auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; ++i) {
+        f();
+    }
+    const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    const long iterations = argc > 1 ? strtol(argv[1], nullptr, 10) : 100000;
+
+    if (!check()) {
+        return EXIT_FAILURE;
+    }
+
+    // one autocomplete request: request line and eight headers
+    const char *line = request_lines[0];
+    const size_t nheaders = 8;
+
+    const double regex_ns = run(iterations, [&]() {
+        Parsed p;
+        Headers h;
+        regex_request_line(line, p);
+        for (size_t i = 0; i < nheaders; ++i) {
+            regex_header(header_lines[i], h);
+        }
+        regex_extension(p.path);
+    });
+    const double plain_ns = run(iterations, [&]() {
+        Parsed p;
+        Headers h;
+        plain_request_line(line, p);
+        for (size_t i = 0; i < nheaders; ++i) {
+            plain_header(header_lines[i], h);
+        }
+        detail::file_extension(p.path);
+    });
+
+    printf("%-10s %12s\n", "parser", "ns/request");
+    printf("%-10s %12.1f\n", "regex", regex_ns);
+    printf("%-10s %12.1f\n", "plain", plain_ns);
+    printf("speedup    %12.1fx\n", regex_ns / plain_ns);
+    return EXIT_SUCCESS;
+}
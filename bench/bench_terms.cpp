@@ -0,0 +1,176 @@
+/*
+ * |data search micro-benchmark: the words of a query looked for in every
+ * definition with one memmem per word, the way SearchData used to, against
+ * TermMatcher with SSE2 and with the Aho-Corasick automaton, checking that
+ * all three find the same definitions.
+ *
+ * usage: bench_terms [definitions-file]
+ * the file holds one definition per line. without a file 200000 made up
+ * ones are used, with the words of an English-like vocabulary drawn the
+ * way they are in text: a few very often, most of them seldom.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "term_matcher.hpp"
+
+namespace {
+
+const char *const vocabulary[] = {
+    "the", "of", "a", "to", "or", "in", "and", "that", "is", "for", "as", "with", "by", "an", "on", "which",
+    "from", "be", "used", "person", "something", "especially", "state", "act", "having", "one", "make",
+    "quality", "place", "form", "part", "group", "water", "small", "large", "time", "way", "made", "body",
+    "kind", "action", "condition", "thing", "become", "cause", "move", "give", "take", "plant", "animal",
+    "family", "genus", "tree", "species", "house", "light", "hand", "head", "line", "point", "order",
+    "power", "system", "number", "money", "work", "land", "sea", "river", "mountain", "city", "music",
+    "language", "church", "law", "government", "war", "ship", "horse", "bird", "fish", "flower", "leaf",
+    "stone", "metal", "iron", "gold", "silver", "glass", "wood", "paper", "cloth", "colour", "red", "green",
+    "blue", "white", "black", "yellow", "brown", "sound", "voice", "word", "name", "letter", "book", "story",
+    "song", "dance", "game", "sport", "ball", "foot", "eye", "heart", "blood", "bone", "skin", "hair",
+    "disease", "medicine", "doctor", "teacher", "student", "school", "college", "science", "chemistry",
+    "physics", "mathematics", "geometry", "astronomy", "philosophy", "religion", "spirit", "mind",
+    "thought", "feeling", "pleasure", "pain", "fear", "anger", "love", "friend", "enemy", "stranger",
+    "journey", "travel", "road", "bridge", "wheel", "engine", "machine", "instrument", "tool", "weapon",
+    "sword", "shield", "armour", "soldier", "officer", "king", "queen", "prince", "lord", "servant",
+    "slave", "prisoner", "judge", "crime", "punishment", "reward", "prize", "payment", "trade",
+    "merchant", "market", "price", "value", "measure", "weight", "length", "distance", "height", "depth",
+    "surface", "edge", "corner", "centre", "middle", "beginning", "end", "morning", "evening", "night",
+    "winter", "summer", "spring", "autumn", "weather", "storm", "rain", "snow", "ice", "fire", "smoke",
+    "ornithological", "cartographic", "hydraulically", "polyphonic", "ecclesiastical", "metallurgy",
+};
+const size_t nvocabulary = sizeof(vocabulary) / sizeof(vocabulary[0]);
+
+// the word of rank r comes up as often as 1 / (r + 1).
+class ZipfWords
+{
+public:
+    ZipfWords()
+    {
+        double sum = 0;
+        for (size_t r = 0; r < nvocabulary; ++r)
+            cumulated.push_back(sum += 1.0 / (r + 1));
+    }
+    const char *operator()(std::mt19937 &rng) const
+    {
+        const double x = std::uniform_real_distribution<double>(0, cumulated.back())(rng);
+        size_t r = 0;
+        while (cumulated[r] < x)
+            ++r;
+        return vocabulary[r];
+    }
+
+private:
+    std::vector<double> cumulated;
+};
+
+std::vector<std::string> make_definitions(size_t n)
+{
+    std::mt19937 rng(42);
+    const ZipfWords word;
+    std::vector<std::string> defs(n);
+    for (auto &d : defs) {
+        d = std::string("<k>") + word(rng) + "</k>\n<tr>" + word(rng) + "</tr>";
+        for (int i = 1 + rng() % 4; i > 0; --i) {
+            d += "\n<abr>n.</abr> ";
+            for (int w = 4 + rng() % 16; w > 0; --w) {
+                d += word(rng);
+                d += w % 7 == 0 ? ", " : " ";
+            }
+            d += "<ex>" + std::string(word(rng)) + " " + word(rng) + "</ex>";
+        }
+    }
+    return defs;
+}
+
+// queries of k words, from the common ones to some that are not there.
+std::vector<std::vector<std::string>> make_queries(size_t k)
+{
+    std::vector<std::vector<std::string>> queries(3);
+    for (size_t i = 0; i < k; ++i) {
+        queries[0].push_back(vocabulary[i % nvocabulary]);
+        queries[1].push_back(vocabulary[(40 + 13 * i) % nvocabulary]);
+        queries[2].push_back(vocabulary[(nvocabulary - 1 - 7 * i) % nvocabulary]);
+    }
+    queries[2].back() = "zyzzyva";
+    return queries;
+}
+
+// the loop of SearchData before TermMatcher, for an entry of one field.
+bool holds_all_memmem(const std::vector<std::string> &words, const std::string &text)
+{
+    size_t nfound = 0;
+    for (const auto &w : words)
+        if (memmem(text.data(), text.size(), w.data(), w.size()))
+            ++nfound;
+    return nfound == words.size();
+}
+
+double now_ms()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template <typename F>
+double run(const std::vector<std::string> &defs, size_t &nfound, F holds_all)
+{
+    nfound = 0;
+    const double t0 = now_ms();
+    for (const auto &d : defs)
+        nfound += holds_all(d);
+    return now_ms() - t0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> defs;
+    if (argc > 1) {
+        std::ifstream in(argv[1]);
+        std::string line;
+        while (std::getline(in, line))
+            if (!line.empty())
+                defs.push_back(line);
+    } else {
+        defs = make_definitions(200000);
+    }
+    size_t bytes = 0;
+    for (const auto &d : defs)
+        bytes += d.size();
+    printf("%zu definitions, %.2f MB\n", defs.size(), bytes / 1e6);
+
+    printf("%6s %10s %10s %10s %10s\n", "words", "found", "memmem", "sse2", "automaton");
+    for (const size_t k : {1, 2, 3, 4, 6, 8, 12, 16, 32}) {
+        double memmem_ms = 0, simd_ms = 0, automaton_ms = 0;
+        size_t total = 0;
+        for (const auto &words : make_queries(k)) {
+            TermMatcher simd(words, words.size()), automaton(words, 0);
+            size_t a, b, c;
+            memmem_ms += run(defs, a, [&words](const std::string &d) { return holds_all_memmem(words, d); });
+            simd_ms += run(defs, b, [&simd](const std::string &d) {
+                simd.reset();
+                return simd.find(d.data(), d.size());
+            });
+            automaton_ms += run(defs, c, [&automaton](const std::string &d) {
+                automaton.reset();
+                return automaton.find(d.data(), d.size());
+            });
+            if (a != b || a != c) {
+                printf("mismatch for %zu words: memmem %zu, sse2 %zu, automaton %zu\n", k, a, b, c);
+                return EXIT_FAILURE;
+            }
+            total += a;
+        }
+        printf("%6zu %10zu %10.2f %10.2f %10.2f\n", k, total, memmem_ms, simd_ms, automaton_ms);
+    }
+
+    return EXIT_SUCCESS;
+}
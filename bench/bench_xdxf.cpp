@@ -0,0 +1,158 @@
+/*
+ * XDXF to HTML micro-benchmark: the :x rules of a format.conf against the
+ * built-in converter (":x native"), on the same entries, checking that
+ * both give the same HTML.
+ *
+ * usage: bench_xdxf [xdxf-file [format.conf]]
+ * the file holds one entry per line, with "\n" for the line breaks in it.
+ * without a file 50000 made up entries are used.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "libwrapper.hpp"
+
+namespace {
+
+const char *const dict_path = "/usr/share/stardict/dic/bench";
+
+std::string make_word(std::mt19937 &rng)
+{
+    static const char *const syllables[] = {
+        "ba", "ce", "di", "fo", "gu", "ha", "je", "ki", "lo", "mu", "na", "pe", "ra", "se", "ti", "vo",
+        "in", "ter", "tion", "re", "un", "able", "ly", "ing", "ed", "er",
+    };
+    const size_t nsyl = sizeof(syllables) / sizeof(syllables[0]);
+    std::string w;
+    for (int i = 1 + rng() % 4; i > 0; --i)
+        w += syllables[rng() % nsyl];
+    return w;
+}
+
+std::vector<std::string> make_entries(size_t n)
+{
+    std::mt19937 rng(42);
+    std::vector<std::string> entries(n);
+    for (auto &e : entries) {
+        const std::string w = make_word(rng);
+        e = "<k>" + w + "</k>\n<tr>" + make_word(rng) + "</tr>";
+        for (int i = 1 + rng() % 6; i > 0; --i) {
+            e += "\n<abr>n.</abr> <c c=\"red\">" + make_word(rng) + "</c> see <kref>" + make_word(rng) +
+                 "</kref> <ex>" + make_word(rng) + " " + make_word(rng) + "</ex>";
+            switch (rng() % 16) {
+            case 0:
+                e += " <c>" + make_word(rng) + "</c>";
+                break;
+            case 1:
+                e += " <kref k=\"" + make_word(rng) + "\">" + make_word(rng) + "</kref>";
+                break;
+            case 2:
+                e += " <kref><b>" + make_word(rng) + "</b></kref>";
+                break;
+            case 3:
+                e += " <i>" + make_word(rng) + "</i> < " + make_word(rng);
+                break;
+            }
+        }
+        switch (rng() % 20) {
+        case 0:
+            e += "\n<rref>" + w + ".wav</rref>";
+            break;
+        case 1:
+            e += "\n<rref>snd/" + w + ".wav</rref>";
+            break;
+        case 2:
+            e += "\n<rref>" + w + ".png</rref>";
+            break;
+        }
+    }
+    return entries;
+}
+
+// a format file with the built-in converter, and the rule the dist :x rules
+// end with.
+std::string write_native_conf()
+{
+    char name[] = "/tmp/bench_xdxf_XXXXXX";
+    const int fd = mkstemp(name);
+    if (fd < 0) {
+        perror("mkstemp");
+        exit(EXIT_FAILURE);
+    }
+    static const char conf[] = ":x native\n/usr/share/stardict/dic=\n";
+    if (write(fd, conf, sizeof(conf) - 1) != sizeof(conf) - 1) {
+        perror("write");
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+    return name;
+}
+
+double now_ms()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double run(const TransformatTemplate &tt, const CBook_it &book, const std::vector<std::string> &entries,
+           std::vector<std::string> &out)
+{
+    out.resize(entries.size());
+    const double t0 = now_ms();
+    for (size_t i = 0; i < entries.size(); ++i)
+        out[i] = tt.generate(book, entries[i].data(), entries[i].size(), 'x');
+    return now_ms() - t0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> entries;
+    if (argc > 1) {
+        std::ifstream in(argv[1]);
+        std::string line;
+        while (std::getline(in, line)) {
+            std::string::size_type pos = 0;
+            while ((pos = line.find("\\n", pos)) != std::string::npos)
+                line.replace(pos, 2, "\n");
+            if (!line.empty())
+                entries.push_back(line);
+        }
+    } else {
+        entries = make_entries(50000);
+    }
+    const char *rules_conf = argc > 2 ? argv[2] : FORMAT_CONF;
+    size_t bytes = 0;
+    for (const auto &e : entries)
+        bytes += e.size();
+    printf("%zu entries, %.2f MB, rules from %s\n", entries.size(), bytes / 1e6, rules_conf);
+
+    std::map<std::string, std::string> books;
+    books["bench"] = dict_path;
+    const CBook_it book = books.begin();
+    const std::string native_conf = write_native_conf();
+    const TransformatTemplate rules(rules_conf, books), native(native_conf.c_str(), books);
+    unlink(native_conf.c_str());
+
+    std::vector<std::string> a, b;
+    const double rules_ms = run(rules, book, entries, a);
+    const double native_ms = run(native, book, entries, b);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (a[i] != b[i]) {
+            printf("mismatch:\n%s\nrules:\n%s\nnative:\n%s\n", entries[i].c_str(), a[i].c_str(), b[i].c_str());
+            return EXIT_FAILURE;
+        }
+    }
+    printf("%-8s %10s %10s\n", "", "ms", "MB/s");
+    printf("%-8s %10.2f %10.2f\n", "rules", rules_ms, bytes / 1e3 / rules_ms);
+    printf("%-8s %10.2f %10.2f\n", "native", native_ms, bytes / 1e3 / native_ms);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,86 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <queue>
+
+#include "aho_corasick.hpp"
+
+void AhoCorasick::clear()
+{
+    delta.assign(256, -1);
+    out.assign(1, -1);
+    lengths.clear();
+    suffix.clear();
+}
+
+void AhoCorasick::add(const std::string &pattern)
+{
+    int state = start();
+    for (const char ch : pattern) {
+        const unsigned char c = ch;
+        if (delta[state * 256 + c] < 0) {
+            delta[state * 256 + c] = out.size();
+            delta.resize(delta.size() + 256, -1);
+            out.push_back(-1);
+        }
+        state = delta[state * 256 + c];
+    }
+    if (out[state] < 0)
+        out[state] = lengths.size();
+    lengths.push_back(pattern.size());
+}
+
+void AhoCorasick::build()
+{
+    std::vector<int32_t> fail(out.size(), 0);
+    suffix.assign(lengths.size(), -1);
+    std::queue<int32_t> todo;
+    for (int c = 0; c < 256; ++c) {
+        int32_t &to = delta[c];
+        if (to < 0) {
+            to = start();
+        } else {
+            fail[to] = start();
+            todo.push(to);
+        }
+    }
+    // breadth first, the fail state of a node is always done before it.
+    while (!todo.empty()) {
+        const int32_t state = todo.front();
+        todo.pop();
+        if (out[state] < 0)
+            out[state] = out[fail[state]];
+        else
+            suffix[out[state]] = out[fail[state]];
+        for (int c = 0; c < 256; ++c) {
+            int32_t &to = delta[state * 256 + c];
+            const int32_t via_fail = delta[fail[state] * 256 + c];
+            if (to < 0) {
+                to = via_fail;
+            } else {
+                fail[to] = via_fail;
+                todo.push(to);
+            }
+        }
+    }
+}
+
+void AhoCorasick::replace(const char *b, const char *e, const std::vector<std::string> &repl, std::string &res) const
+{
+    res.reserve(res.size() + (e - b));
+    const char *copied = b;
+    int state = start();
+    for (const char *p = b; p != e; ++p) {
+        state = next(state, *p);
+        const int id = match(state);
+        if (id < 0)
+            continue;
+        const char *mstart = p + 1 - lengths[id];
+        res.append(copied, mstart);
+        res += repl[id];
+        copied = p + 1;
+        state = start();
+    }
+    res.append(copied, e);
+}
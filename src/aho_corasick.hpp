@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Aho-Corasick automaton over bytes. Patterns are added, then build() turns
+// the trie into a full transition table, so the text is scanned with one
+// table lookup per byte whatever the number of patterns.
+class AhoCorasick
+{
+public:
+    AhoCorasick() { clear(); }
+
+    void clear();
+    // the id of a pattern is the number of patterns added before it.
+    void add(const std::string &pattern);
+    void build();
+
+    size_t size() const { return lengths.size(); }
+    size_t length(int id) const { return lengths[id]; }
+
+    static int start() { return 0; }
+    int next(int state, unsigned char c) const { return delta[state * 256 + c]; }
+    // id of a pattern ending at state, -1 for none.
+    int match(int state) const { return out[state]; }
+    // Another pattern ending where pattern id does, a suffix of it, -1 for
+    // none. From match(state) on, gives all the distinct patterns ending at
+    // state, the first added of each.
+    int shorter(int id) const { return suffix[id]; }
+
+    // Copies [b, e) to res with every match of pattern i replaced by
+    // repl[i], scanning left to right. A match is replaced as soon as it
+    // ends and the scan starts over after it, so matches do not overlap.
+    void replace(const char *b, const char *e, const std::vector<std::string> &repl, std::string &res) const;
+
+private:
+    std::vector<int32_t> delta; // 256 per state, trie edges until build()
+    std::vector<int32_t> out;
+    std::vector<int32_t> suffix; // by pattern id
+    std::vector<size_t> lengths;
+};
@@ -29,12 +29,11 @@
 #include "config.h"
 #endif
 
-#include <cassert>
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <fcntl.h>
-#include <limits.h>
 #include <unistd.h>
 
 #include <sys/stat.h>
@@ -271,8 +270,6 @@ bool DictData::open(const std::string &fname, int computeCRC)
     struct stat sb;
     int fd;
 
-    this->initialized = 0;
-
     if (stat(fname.c_str(), &sb) || !S_ISREG(sb.st_mode)) {
         //err_warning( __FUNCTION__,
         //   "%s is not a regular file -- ignoring\n", fname );
@@ -304,13 +301,6 @@ bool DictData::open(const std::string &fname, int computeCRC)
     this->start = mapfile.begin();
     this->end = this->start + this->size;
 
-    for (size_t j = 0; j < DICT_CACHE_SIZE; j++) {
-        cache[j].chunk = -1;
-        cache[j].stamp = -1;
-        cache[j].inBuffer = nullptr;
-        cache[j].count = 0;
-    }
-
     return true;
 }
 
@@ -320,33 +310,68 @@ void DictData::close()
         free(this->chunks);
     if (this->offsets)
         free(this->offsets);
+    this->chunks = nullptr;
+    this->offsets = nullptr;
+}
 
-    if (this->initialized) {
-        if (inflateEnd(&this->zStream)) {
+namespace
+{
+// The raw deflate stream of a thread, the chunks of all the files are
+// inflated with it.
+class InflateStream
+{
+public:
+    InflateStream()
+    {
+        memset(&zStream, 0, sizeof(zStream));
+        ok = inflateInit2(&zStream, -15) == Z_OK;
+    }
+    ~InflateStream()
+    {
+        if (ok)
+            inflateEnd(&zStream);
+    }
+    InflateStream(const InflateStream &) = delete;
+    InflateStream &operator=(const InflateStream &) = delete;
+
+    // inflates the chunk [in, in + in_size) to out, returns the bytes written.
+    unsigned long inflate_chunk(const char *in, unsigned long in_size, char *out, unsigned long out_size)
+    {
+        if (!ok)
+            return 0;
+        // the last chunk of a file ends the deflate stream, so each chunk
+        // starts from a clean state.
+        inflateReset(&zStream);
+        zStream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in));
+        zStream.avail_in = in_size;
+        zStream.next_out = reinterpret_cast<Bytef *>(out);
+        zStream.avail_out = out_size;
+        if (inflate(&zStream, Z_PARTIAL_FLUSH) != Z_OK) {
+            //err_fatal( __FUNCTION__, "inflate: %s\n", zStream.msg );
+        }
+        if (zStream.avail_in) {
             //err_internal( __FUNCTION__,
-            //       "Cannot shut down inflation engine: %s\n",
-            //     this->zStream.msg );
+            //    "inflate did not flush (%d pending, %d avail)\n",
+            //  zStream.avail_in, zStream.avail_out );
         }
+        return out_size - zStream.avail_out;
     }
 
-    for (size_t i = 0; i < DICT_CACHE_SIZE; ++i) {
-        if (this->cache[i].inBuffer)
-            free(this->cache[i].inBuffer);
-    }
+private:
+    z_stream zStream;
+    bool ok;
+};
+
+thread_local InflateStream inflate_stream;
 }
 
-void DictData::read(char *buffer, unsigned long start, unsigned long size)
+void DictData::read(DictReadContext &ctx, char *buffer, unsigned long start, unsigned long size) const
 {
     char *pt;
     unsigned long end;
-    int count;
-    char *inBuffer;
-    char outBuffer[OUT_BUFFER_SIZE];
     int firstChunk, lastChunk;
     int firstOffset, lastOffset;
     int i;
-    int found, target, lastStamp;
-    static int stamp = 0;
 
     end = start + size;
 
@@ -368,21 +393,6 @@ void DictData::read(char *buffer, unsigned long start, unsigned long size)
         //buffer[size] = '\0';
         break;
     case DICT_DZIP:
-        if (!this->initialized) {
-            ++this->initialized;
-            this->zStream.zalloc = nullptr;
-            this->zStream.zfree = nullptr;
-            this->zStream.opaque = nullptr;
-            this->zStream.next_in = 0;
-            this->zStream.avail_in = 0;
-            this->zStream.next_out = nullptr;
-            this->zStream.avail_out = 0;
-            if (inflateInit2(&this->zStream, -15) != Z_OK) {
-                //err_internal( __FUNCTION__,
-                //  "Cannot initialize inflation engine: %s\n",
-                //this->zStream.msg );
-            }
-        }
         firstChunk = start / this->chunkLength;
         firstOffset = start - firstChunk * this->chunkLength;
         lastChunk = end / this->chunkLength;
@@ -393,82 +403,53 @@ void DictData::read(char *buffer, unsigned long start, unsigned long size)
         //" lastChunk = %d, lastOffset = %d\n",
         //start, end, firstChunk, firstOffset, lastChunk, lastOffset ));
         for (pt = buffer, i = firstChunk; i <= lastChunk; i++) {
+            // the part of chunk i that is read.
+            const int from = i == firstChunk ? firstOffset : 0;
+            const int to = i == lastChunk ? lastOffset : this->chunkLength;
+            if (to <= from)
+                continue;
 
             /* Access cache */
-            found = 0;
-            target = 0;
-            lastStamp = INT_MAX;
-            for (size_t j = 0; j < DICT_CACHE_SIZE; j++) {
+            const DictChunkKey key{this, i};
+            std::shared_ptr<const std::string> chunk;
 #if USE_CACHE
-                if (this->cache[j].chunk == i) {
-                    found = 1;
-                    target = j;
-                    break;
-                }
+            if (ctx.last_key == key)
+                chunk = ctx.last;
+            else if (ctx.chunk_cache)
+                chunk = ctx.chunk_cache->get(key);
 #endif
-                if (this->cache[j].stamp < lastStamp) {
-                    lastStamp = this->cache[j].stamp;
-                    target = j;
-                }
-            }
-
-            this->cache[target].stamp = ++stamp;
-            if (found) {
-                count = this->cache[target].count;
-                inBuffer = this->cache[target].inBuffer;
+            if (chunk) {
+                ++ctx.hits;
             } else {
-                this->cache[target].chunk = i;
-                if (!this->cache[target].inBuffer)
-                    this->cache[target].inBuffer = (char *)malloc(IN_BUFFER_SIZE);
-                inBuffer = this->cache[target].inBuffer;
-
+                ++ctx.misses;
                 if (this->chunks[i] >= OUT_BUFFER_SIZE) {
                     //err_internal( __FUNCTION__,
                     //    "this->chunks[%d] = %d >= %ld (OUT_BUFFER_SIZE)\n",
                     //  i, this->chunks[i], OUT_BUFFER_SIZE );
                 }
-                memcpy(outBuffer, this->start + this->offsets[i], this->chunks[i]);
-
-                this->zStream.next_in = (Bytef *)outBuffer;
-                this->zStream.avail_in = this->chunks[i];
-                this->zStream.next_out = (Bytef *)inBuffer;
-                this->zStream.avail_out = IN_BUFFER_SIZE;
-                if (inflate(&this->zStream, Z_PARTIAL_FLUSH) != Z_OK) {
-                    //err_fatal( __FUNCTION__, "inflate: %s\n", this->zStream.msg );
-                }
-                if (this->zStream.avail_in) {
-                    //err_internal( __FUNCTION__,
-                    //    "inflate did not flush (%d pending, %d avail)\n",
-                    //  this->zStream.avail_in, this->zStream.avail_out );
-                }
-
-                count = IN_BUFFER_SIZE - this->zStream.avail_out;
-
-                this->cache[target].count = count;
-            }
-
-            if (i == firstChunk) {
-                if (i == lastChunk) {
-                    memcpy(pt, inBuffer + firstOffset, lastOffset - firstOffset);
-                    pt += lastOffset - firstOffset;
-                } else {
-                    if (count != this->chunkLength) {
+                if (from == 0 && to == this->chunkLength) {
+                    // all of it is read, straight to the buffer.
+                    const unsigned long count = inflate_stream.inflate_chunk(this->start + this->offsets[i], this->chunks[i], pt, to);
+                    if (count != static_cast<unsigned long>(this->chunkLength)) {
                         //err_internal( __FUNCTION__,
                         //    "Length = %d instead of %d\n",
                         //count, this->chunkLength );
                     }
-                    memcpy(pt, inBuffer + firstOffset,
-                           this->chunkLength - firstOffset);
-                    pt += this->chunkLength - firstOffset;
+                    pt += to;
+                    continue;
                 }
-            } else if (i == lastChunk) {
-                memcpy(pt, inBuffer, lastOffset);
-                pt += lastOffset;
-            } else {
-                assert(count == this->chunkLength);
-                memcpy(pt, inBuffer, this->chunkLength);
-                pt += this->chunkLength;
+                std::shared_ptr<std::string> inflated = std::make_shared<std::string>(IN_BUFFER_SIZE, '\0');
+                inflated->resize(inflate_stream.inflate_chunk(this->start + this->offsets[i], this->chunks[i],
+                                                              &(*inflated)[0], IN_BUFFER_SIZE));
+                if (ctx.chunk_cache)
+                    ctx.chunk_cache->put(key, inflated, inflated->capacity() + sizeof(std::string) + sizeof(key) + 64);
+                chunk = std::move(inflated);
             }
+            ctx.last_key = key;
+            ctx.last = chunk;
+
+            memcpy(pt, chunk->data() + from, to - from);
+            pt += to - from;
         }
         //*pt = '\0';
         break;
@@ -477,3 +458,57 @@ void DictData::read(char *buffer, unsigned long start, unsigned long size)
         break;
     }
 }
+
+const std::string &DictScanner::chunk(int i)
+{
+    if (i == current)
+        return *inflated;
+    current = i;
+    cached = ctx.chunk_cache ? ctx.chunk_cache->peek(DictChunkKey{&dict, i}) : nullptr;
+    if (cached) {
+        ++ctx.hits;
+        inflated = cached.get();
+        return *inflated;
+    }
+    ++ctx.misses;
+    own.resize(IN_BUFFER_SIZE);
+    own.resize(i < dict.chunkCount ? inflate_stream.inflate_chunk(dict.start + dict.offsets[i], dict.chunks[i], &own[0], IN_BUFFER_SIZE)
+                                   : 0);
+    inflated = &own;
+    return own;
+}
+
+const char *DictScanner::read(unsigned long start, unsigned long size)
+{
+    if (dict.type == DICT_TEXT)
+        return dict.start + start;
+    if (dict.type != DICT_DZIP) {
+        spanned.assign(size, '\0');
+        return spanned.data();
+    }
+
+    const unsigned long end = start + size;
+    const int firstChunk = start / dict.chunkLength;
+    const int firstOffset = start - firstChunk * dict.chunkLength;
+    const int lastChunk = end / dict.chunkLength;
+    const int lastOffset = end - lastChunk * dict.chunkLength;
+    if (firstChunk == lastChunk || (firstChunk + 1 == lastChunk && lastOffset == 0)) {
+        const std::string &c = chunk(firstChunk);
+        if (c.size() >= firstOffset + size)
+            return c.data() + firstOffset;
+    }
+    spanned.assign(size, '\0');
+    char *pt = &spanned[0];
+    for (int i = firstChunk; i <= lastChunk; i++) {
+        const int from = i == firstChunk ? firstOffset : 0;
+        const int to = i == lastChunk ? lastOffset : dict.chunkLength;
+        if (to <= from)
+            continue;
+        const std::string &c = chunk(i);
+        // a chunk cut short leaves zeros.
+        if (c.size() > size_t(from))
+            memcpy(pt, c.data() + from, std::min<size_t>(to, c.size()) - from);
+        pt += to - from;
+    }
+    return spanned.data();
+}
@@ -4,34 +4,69 @@
 #include <string>
 #include <zlib.h>
 
+#include "lrucache.hpp"
 #include "mapfile.hpp"
 
-struct DictCache {
+class DictData;
+
+struct DictChunkKey {
+    const DictData *owner;
     int chunk;
-    char *inBuffer;
-    int stamp;
-    int count;
+    bool operator==(const DictChunkKey &o) const { return owner == o.owner && chunk == o.chunk; }
+};
+struct DictChunkKeyHash {
+    size_t operator()(const DictChunkKey &k) const
+    {
+        return std::hash<const void *>()(k.owner) * 31 + k.chunk;
+    }
 };
+// decompressed chunks of all the .dict.dz files.
+using DictChunkCache = LruCache<DictChunkKey, std::string, DictChunkKeyHash>;
 
-class DictData
+// The chunk read last of one query. DictData itself is read-only after
+// open(), several threads may read it with their own context. The inflate
+// stream is one per thread.
+class DictReadContext
 {
 public:
-    static const size_t DICT_CACHE_SIZE = 5;
+    // chunks may be nullptr, for no cache shared with other queries.
+    explicit DictReadContext(DictChunkCache *chunks = nullptr)
+        : chunk_cache(chunks)
+    {
+    }
+    DictReadContext(const DictReadContext &) = delete;
+    DictReadContext &operator=(const DictReadContext &) = delete;
+
+    // chunks found in / missing from the cache.
+    unsigned long hits = 0;
+    unsigned long misses = 0;
+
+private:
+    friend class DictData;
+    friend class DictScanner;
+
+    DictChunkCache *const chunk_cache;
+    DictChunkKey last_key{nullptr, -1};
+    std::shared_ptr<const std::string> last;
+};
 
+class DictData
+{
+public:
     DictData() {}
     ~DictData() { close(); }
     bool open(const std::string &filename, int computeCRC);
     void close();
-    void read(char *buffer, unsigned long start, unsigned long size);
+    void read(DictReadContext &ctx, char *buffer, unsigned long start, unsigned long size) const;
 
 private:
+    friend class DictScanner;
+
     const char *start; /* start of mmap'd area */
     const char *end; /* end of mmap'd area */
     unsigned long size; /* size of mmap */
 
     int type;
-    z_stream zStream;
-    int initialized;
 
     int headerLength;
     int method;
@@ -42,15 +77,46 @@ private:
     int version;
     int chunkLength;
     int chunkCount;
-    int *chunks;
-    unsigned long *offsets; /* Sum-scan of chunks. */
+    int *chunks = nullptr;
+    unsigned long *offsets = nullptr; /* Sum-scan of chunks. */
     std::string origFilename;
     std::string comment;
     unsigned long crc;
     unsigned long length;
     unsigned long compressedLength;
-    DictCache cache[DICT_CACHE_SIZE];
     MapFile mapfile;
 
     int read_header(const std::string &filename, int computeCRC);
 };
+
+// Reads the entries of a scan over a whole .dict.dz in file order: each
+// chunk is inflated once, when the scan gets to it, unless the cache of ctx
+// has it already. The scan only peeks at the cache, it neither adds the
+// chunks it inflates nor makes the ones it finds recently used, so point
+// lookups keep their chunks. An entry within one chunk is not copied.
+class DictScanner
+{
+public:
+    DictScanner(const DictData &data, DictReadContext &context)
+        : dict(data), ctx(context)
+    {
+    }
+    DictScanner(const DictScanner &) = delete;
+    DictScanner &operator=(const DictScanner &) = delete;
+
+    // The bytes [start, start + size), valid until the next read. Reading
+    // the entries by ascending start inflates no chunk twice.
+    const char *read(unsigned long start, unsigned long size);
+
+private:
+    // the bytes of chunk i, which go on to the end of the string.
+    const std::string &chunk(int i);
+
+    const DictData &dict;
+    DictReadContext &ctx;
+    int current = -1; // the chunk inflated points to
+    const std::string *inflated = nullptr; // cached or own
+    std::shared_ptr<const std::string> cached;
+    std::string own; // the chunk inflated by the scan
+    std::string spanned; // an entry over several chunks
+};
@@ -33,3 +33,87 @@ The Levenshtein distance algorithm has been used in:
     * Plagiarism detection 
 */
 
+#include "distance.hpp"
+
+#include <cstring>
+
+BitParallelDistance::BitParallelDistance(const char *pattern)
+    : m(strlen(pattern))
+    , words((m + 63) / 64)
+{
+    if (words == 0)
+        words = 1;
+    peq.assign(256 * words, 0);
+    for (int i = 0; i < m; ++i)
+        peq[static_cast<unsigned char>(pattern[i]) * words + i / 64] |= uint64_t(1) << (i % 64);
+}
+
+int BitParallelDistance::single_word(const char *t, int n, int limit) const
+{
+    const uint64_t last = uint64_t(1) << (m - 1);
+    uint64_t vp = ~uint64_t(0), vn = 0, d0 = 0, pm_old = 0;
+    int dist = m;
+
+    for (int j = 0; j < n; ++j) {
+        const uint64_t pm = peq[static_cast<unsigned char>(t[j])];
+        const uint64_t tr = (((~d0) & pm) << 1) & pm_old;
+        d0 = (((pm & vp) + vp) ^ vp) | pm | vn | tr;
+        uint64_t hp = vn | ~(d0 | vp);
+        uint64_t hn = d0 & vp;
+        if (hp & last)
+            ++dist;
+        else if (hn & last)
+            --dist;
+        // each remaining byte lowers the distance by one at most.
+        if (dist - (n - j - 1) >= limit)
+            return dist - (n - j - 1);
+        hp = (hp << 1) | 1;
+        hn <<= 1;
+        vp = hn | ~(d0 | hp);
+        vn = hp & d0;
+        pm_old = pm;
+    }
+    return dist;
+}
+
+int BitParallelDistance::multi_word(const char *t, int n, int limit) const
+{
+    const uint64_t last = uint64_t(1) << ((m - 1) % 64);
+    struct column {
+        uint64_t vp, vn, d0, pm;
+    };
+    // slot 0 stands for the empty block below the first one.
+    std::vector<column> prev(words + 1, column{~uint64_t(0), 0, 0, 0});
+    std::vector<column> cur(words + 1, column{~uint64_t(0), 0, 0, 0});
+    int dist = m;
+
+    for (int j = 0; j < n; ++j) {
+        const uint64_t *pms = &peq[static_cast<unsigned char>(t[j]) * words];
+        uint64_t hp_carry = 1, hn_carry = 0;
+        for (int w = 0; w < words; ++w) {
+            const column &old = prev[w + 1];
+            const uint64_t pm = pms[w];
+            const uint64_t tr = ((((~old.d0) & pm) << 1) | (((~prev[w].d0) & cur[w].pm) >> 63)) & old.pm;
+            const uint64_t x = pm | hn_carry;
+            const uint64_t d0 = (((x & old.vp) + old.vp) ^ old.vp) | x | old.vn | tr;
+            uint64_t hp = old.vn | ~(d0 | old.vp);
+            uint64_t hn = d0 & old.vp;
+            if (w == words - 1) {
+                if (hp & last)
+                    ++dist;
+                else if (hn & last)
+                    --dist;
+            }
+            const uint64_t hp_out = hp >> 63, hn_out = hn >> 63;
+            hp = (hp << 1) | hp_carry;
+            hn = (hn << 1) | hn_carry;
+            hp_carry = hp_out;
+            hn_carry = hn_out;
+            cur[w + 1] = column{hn | ~(d0 | hp), hp & d0, d0, pm};
+        }
+        if (dist - (n - j - 1) >= limit)
+            return dist - (n - j - 1);
+        prev.swap(cur);
+    }
+    return dist;
+}
@@ -43,6 +43,7 @@ Enhanced Dynamic Programming ASM Algorithm"
 */
 #include <cstdlib>
 #include <cstdint>
+#include <vector>
 
 #define COVER_TRANSPOSITION
 /****************************************/
@@ -163,3 +164,39 @@ private:
     int *d;
     int currentelements;
 };
+
+/*
+Bit-parallel form of the same distance (insertion, deletion, substitution
+and transposition of adjacent characters), after:
+Hyyro, Heikki : "A Bit-Vector Algorithm for Computing Levenshtein and
+Damerau Edit Distances", Nordic Journal of Computing 10 (2003).
+The pattern is compiled once into one bit mask per byte value, each text
+is then scanned one byte at a time with a few word operations. Patterns up
+to 64 bytes fit in a machine word, longer ones are split into blocks.
+*/
+class BitParallelDistance
+{
+public:
+    explicit BitParallelDistance(const char *pattern);
+    BitParallelDistance(const BitParallelDistance &) = delete;
+    BitParallelDistance &operator=(const BitParallelDistance &) = delete;
+
+    int length() const { return m; }
+    /*Distance between the first n bytes of t and the pattern. It is the same
+      as EditDistance::CalEditDistance() when that is below limit, otherwise
+      a value not less than limit.*/
+    int CalEditDistance(const char *t, int n, const int limit) const
+    {
+        if (m == 0 || n == 0)
+            return m + n;
+        return words == 1 ? single_word(t, n, limit) : multi_word(t, n, limit);
+    }
+
+private:
+    int single_word(const char *t, int n, int limit) const;
+    int multi_word(const char *t, int n, int limit) const;
+
+    int m;
+    int words;
+    std::vector<uint64_t> peq; // [byte * words + word]
+};
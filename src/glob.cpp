@@ -0,0 +1,147 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstring>
+
+#include "glob.hpp"
+
+namespace
+{
+inline char ascii_lower(char c)
+{
+    return static_cast<unsigned char>(c - 'A') < 26 ? c + ('a' - 'A') : c;
+}
+
+// past the UTF-8 character at p, or past the stray byte at p.
+inline const char *next_char(const char *p)
+{
+    for (++p; (*p & 0xC0) == 0x80; ++p)
+        ;
+    return p;
+}
+}
+
+GlobPattern::GlobPattern(const char *p)
+{
+    bool literal = true, star = true;
+    for (; *p; ++p) {
+        if (*p == '*') {
+            literal = false;
+            star = true;
+            if (text.empty())
+                star_first = true;
+            continue;
+        }
+        if (star) {
+            segments.push_back({uint32_t(text.size()), 0, true});
+            star = false;
+        }
+        if (*p == '?') {
+            literal = false;
+            segments.back().fixed = false;
+            text += '\0';
+            any.push_back(true);
+            continue;
+        }
+        if (*p == '\\' && !*++p)
+            break;
+        if (literal)
+            literal_prefix += *p;
+        text += ascii_lower(*p);
+        any.push_back(false);
+    }
+    for (auto &seg : segments)
+        seg.end = &seg == &segments.back() ? text.size() : (&seg + 1)->begin;
+    star_last = star && !text.empty();
+}
+
+bool GlobPattern::match_at(const Segment &seg, const char *p, const char *e, const char *&end) const
+{
+    if (seg.fixed) {
+        if (size_t(e - p) < seg.end - seg.begin)
+            return false;
+        for (uint32_t i = seg.begin; i < seg.end; ++i, ++p)
+            if (ascii_lower(*p) != text[i])
+                return false;
+        end = p;
+        return true;
+    }
+    for (uint32_t i = seg.begin; i < seg.end; ++i) {
+        if (p >= e)
+            return false;
+        if (any[i])
+            p = next_char(p);
+        else if (ascii_lower(*p++) != text[i])
+            return false;
+    }
+    end = p;
+    return p <= e;
+}
+
+bool GlobPattern::match(const char *key) const
+{
+    if (segments.empty()) // "" or only stars
+        return star_first || !*key;
+    const char *k = key, *end;
+    size_t first = 0, last = segments.size();
+    if (!star_first) {
+        // no need to know where the key ends, it ends at a byte that is not in text.
+        const Segment &head = segments[0];
+        for (uint32_t i = head.begin; i < head.end; ++i) {
+            if (any[i]) {
+                if (!*k)
+                    return false;
+                k = next_char(k);
+            } else if (ascii_lower(*k++) != text[i]) {
+                return false;
+            }
+        }
+        if (segments.size() == 1 && !star_last)
+            return !*k;
+        first = 1;
+    }
+    const char *e = k + strlen(k);
+    // the last segment sits at the end of the key.
+    const Segment *tail = nullptr;
+    if (!star_last && first < last) {
+        tail = &segments[--last];
+        if (tail->fixed) {
+            const size_t len = tail->end - tail->begin;
+            if (size_t(e - k) < len || !match_at(*tail, e - len, e, end))
+                return false;
+            e -= len;
+            tail = nullptr;
+        }
+    }
+    for (size_t s = first; s < last; ++s) {
+        const Segment &seg = segments[s];
+        if (any[seg.begin]) {
+            for (;; k = next_char(k)) {
+                if (k >= e)
+                    return false;
+                if (match_at(seg, k, e, end))
+                    break;
+            }
+        } else {
+            // a byte of the pattern is never inside a character of the key.
+            const char c = text[seg.begin];
+            for (;; ++k) {
+                if (k >= e)
+                    return false;
+                if (ascii_lower(*k) == c && match_at(seg, k, e, end))
+                    break;
+            }
+        }
+        k = end;
+    }
+    if (!tail)
+        return true;
+    // a tail with '?' is as long as the characters it takes.
+    for (;; k = next_char(k)) {
+        if (match_at(*tail, k, e, end) && end == e)
+            return true;
+        if (k >= e)
+            return false;
+    }
+}
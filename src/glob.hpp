@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A wildcard query: '*' for any text, '?' for any one UTF-8 character,
+// '\' to take the next character as it is. ASCII letters match in either
+// case. The pattern is compiled once, match() allocates nothing.
+// The literal text before the first wildcard pins the keys that can match
+// to one range of a dictionary index, see prefix().
+class GlobPattern
+{
+public:
+    explicit GlobPattern(const char *pattern);
+
+    // the literal text every matching key starts with, in either case.
+    const std::string &prefix() const { return literal_prefix; }
+    bool match(const char *key) const;
+
+private:
+    // The text between two stars: bytes in either case and '?'s. Between
+    // the first and the last, the leftmost place a segment matches at is
+    // always as good as any later one, so nothing is ever tried twice.
+    struct Segment {
+        uint32_t begin, end; // of text
+        bool fixed; // no '?', so as long as it is
+    };
+    // whether seg matches at p, not going past e, and where it ends then.
+    bool match_at(const Segment &seg, const char *p, const char *e, const char *&end) const;
+
+    std::string literal_prefix;
+    std::string text; // lower-cased bytes, '\0' for '?'
+    std::vector<bool> any; // which bytes of text are '?'
+    std::vector<Segment> segments;
+    bool star_first = false, star_last = false;
+};
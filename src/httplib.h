@@ -36,7 +36,6 @@
 
 typedef SOCKET socket_t;
 #else
-//#include <pthread.h>//do not link pthread.
 #include <unistd.h>
 #include <netdb.h>
 #include <cstring>
@@ -44,17 +43,27 @@ typedef SOCKET socket_t;
 #include <arpa/inet.h>
 #include <signal.h>
 #include <sys/socket.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
 
 typedef int socket_t;
 #endif
 
+#include <chrono>
+#include <condition_variable>
 #include <fstream>
 #include <functional>
+#include <list>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <regex>
 #include <string>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <assert.h>
@@ -73,6 +82,12 @@ typedef int socket_t;
 #define CPPHTTPLIB_KEEPALIVE_MAX_COUNT 5
 #define CPPHTTPLIB_KEEPALIVE_TIMEOUT_SECOND 5
 #define CPPHTTPLIB_KEEPALIVE_TIMEOUT_USECOND 0
+#define CPPHTTPLIB_LISTEN_BACKLOG 64
+#define CPPHTTPLIB_THREAD_POOL_QUEUE_PER_THREAD 8
+#define CPPHTTPLIB_EVENT_LOOP_KEEPALIVE_MAX_COUNT 1000
+#define CPPHTTPLIB_EVENT_LOOP_IDLE_TIMEOUT_SECOND 60
+#define CPPHTTPLIB_EVENT_LOOP_MAX_REQUEST_SIZE 65536
+#define CPPHTTPLIB_EVENT_LOOP_MAX_EVENTS 64
 
 namespace httplib
 {
@@ -184,6 +199,111 @@ private:
     socket_t sock_;
 };
 
+// Reads a request that has already been received in full and collects the
+// response in memory, so the worker running it never touches the socket.
+class BufferStream : public Stream {
+public:
+    BufferStream(const std::string& in, std::string& out);
+    virtual ~BufferStream();
+
+    virtual int read(char* ptr, size_t size);
+    virtual int write(const char* ptr, size_t size);
+    virtual int write(const char* ptr);
+
+private:
+    const std::string& in_;
+    size_t pos_;
+    std::string& out_;
+};
+
+// Fixed number of workers fed from a bounded queue. enqueue() blocks while
+// the queue is full, so a flood of connections backs up into the listen
+// backlog instead of growing memory without limit. A job the pool does not
+// take is left to the caller, enqueue() then returns false.
+class ThreadPool {
+public:
+    ThreadPool(size_t thread_count, size_t queue_limit)
+        : queue_limit_(queue_limit ? queue_limit : 1)
+        , shutdown_(false)
+    {
+        while (thread_count--) {
+            threads_.emplace_back([this]() { worker(); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        shutdown();
+    }
+
+    // false once shutdown() has started.
+    bool enqueue(std::function<void()> fn) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this]() { return shutdown_ || jobs_.size() < queue_limit_; });
+        if (shutdown_) {
+            return false;
+        }
+        jobs_.push_back(std::move(fn));
+        not_empty_.notify_one();
+        return true;
+    }
+
+    // Like enqueue() but never waits, false when the queue is full too.
+    bool try_enqueue(std::function<void()> fn) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (shutdown_ || jobs_.size() >= queue_limit_) {
+            return false;
+        }
+        jobs_.push_back(std::move(fn));
+        not_empty_.notify_one();
+        return true;
+    }
+
+    // Runs the jobs already queued, then joins the workers.
+    void shutdown() {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (shutdown_) {
+                return;
+            }
+            shutdown_ = true;
+        }
+        not_empty_.notify_all();
+        not_full_.notify_all();
+        for (auto& t: threads_) {
+            t.join();
+        }
+    }
+
+private:
+    void worker() {
+        for (;;) {
+            std::function<void()> fn;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                not_empty_.wait(lock, [this]() { return shutdown_ || !jobs_.empty(); });
+                if (jobs_.empty()) {
+                    break; // shut down and drained
+                }
+                fn = std::move(jobs_.front());
+                jobs_.pop_front();
+                not_full_.notify_one();
+            }
+            fn();
+        }
+    }
+
+    const size_t queue_limit_;
+    bool shutdown_;
+    std::vector<std::thread> threads_;
+    std::list<std::function<void()>> jobs_;
+    std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+};
+
 class Server {
 public:
     typedef std::function<void (const Request&, Response&)> Handler;
@@ -203,6 +323,13 @@ public:
     void set_error_handler(Handler handler);
     void set_logger(Logger logger);
 
+    // 0 threads serves every connection inline on the listening thread.
+    void set_thread_count(size_t thread_count, size_t queue_limit = 0);
+
+    // Watch all connections from one epoll thread and give the workers only
+    // complete requests. Linux only, returns false where it is unsupported.
+    bool set_event_loop(bool on);
+
     bool listen(const char* host, int port, int socket_flags = 0);
 
     bool is_running() const;
@@ -214,7 +341,16 @@ protected:
     const HttpVersion http_version_;
 
 private:
-    typedef std::vector<std::pair<std::regex, Handler>> Handlers;
+    // Patterns without regex metacharacters are compared as plain strings
+    // and leave Request::matches empty.
+    struct Route {
+        std::string path;
+        std::unique_ptr<std::regex> pattern;
+        Handler handler;
+    };
+    typedef std::vector<Route> Handlers;
+
+    static void add_route(Handlers& handlers, const char* pattern, Handler handler);
 
     socket_t create_server_socket(const char* host, int port, int socket_flags) const;
 
@@ -222,7 +358,7 @@ private:
     bool handle_file_request(Request& req, Response& res);
     bool dispatch_request(Request& req, Response& res, Handlers& handlers);
 
-    bool parse_request_line(const char* s, Request& req);
+    bool parse_request_line(const char* s, size_t len, Request& req);
     void write_response(Stream& strm, bool last_connection, const Request& req, Response& res);
 
     virtual bool read_and_close_socket(socket_t sock);
@@ -233,6 +369,9 @@ private:
     Handlers    post_handlers_;
     Handler     error_handler_;
     Logger      logger_;
+    size_t      thread_count_;
+    size_t      queue_limit_;
+    bool        event_loop_;
 };
 
 class Client {
@@ -353,6 +492,69 @@ void split(const char* b, const char* e, char d, Fn fn)
     }
 }
 
+// A piece of a buffer owned by someone else, used by the parsers so that
+// nothing is copied until a field is stored.
+struct string_ref {
+    const char* b;
+    const char* e;
+
+    string_ref() : b(nullptr), e(nullptr) {}
+    string_ref(const char* b_, const char* e_) : b(b_), e(e_) {}
+
+    size_t size() const { return e - b; }
+    bool empty() const { return b == e; }
+    std::string str() const { return std::string(b, e); }
+};
+
+struct request_line {
+    string_ref method;
+    string_ref path;    // still url encoded
+    string_ref query;   // without '?', may be empty
+    string_ref version;
+};
+
+// Parses "(GET|HEAD|POST) path[?query] HTTP/1.[01]\r\n" in one pass.
+inline bool parse_request_line(const char* b, const char* e, request_line& rl)
+{
+    if (e - b < 2 || e[-2] != '\r' || e[-1] != '\n') {
+        return false;
+    }
+    e -= 2;
+
+    // " HTTP/1.x" at the end
+    if (e - b < 9 || e[-9] != ' ' || memcmp(e - 8, "HTTP/1.", 7) || (e[-1] != '0' && e[-1] != '1')) {
+        return false;
+    }
+    rl.version = string_ref(e - 8, e);
+    e -= 9;
+
+    size_t n;
+    if (e - b > 4 && !memcmp(b, "GET ", 4)) {
+        n = 3;
+    } else if (e - b > 5 && (!memcmp(b, "HEAD ", 5) || !memcmp(b, "POST ", 5))) {
+        n = 4;
+    } else {
+        return false;
+    }
+    rl.method = string_ref(b, b + n);
+    b += n + 1;
+
+    auto q = static_cast<const char*>(memchr(b, '?', e - b));
+    if (!q) {
+        rl.path = string_ref(b, e);
+        rl.query = string_ref(e, e);
+        return true;
+    }
+
+    // both parts must not be empty and the query is a single line
+    if (q == b || q + 1 == e || memchr(q + 1, '\r', e - q - 1) || memchr(q + 1, '\n', e - q - 1)) {
+        return false;
+    }
+    rl.path = string_ref(b, q);
+    rl.query = string_ref(q + 1, e);
+    return true;
+}
+
 // NOTE: until the read size reaches `fixed_buffer_size`, use `fixed_buffer`
 // to store data. The call can set memory on stack for performance.
 class stream_line_reader {
@@ -371,6 +573,14 @@ public:
         }
     }
 
+    size_t size() const {
+        if (glowable_buffer_.empty()) {
+            return fixed_buffer_used_size_;
+        } else {
+            return glowable_buffer_.size();
+        }
+    }
+
     bool getline() {
         fixed_buffer_used_size_ = 0;
         glowable_buffer_.clear();
@@ -571,6 +781,356 @@ inline bool is_connection_error()
 #endif
 }
 
+#ifdef __linux__
+// Length of the first complete request in `buf`, 0 while more bytes are
+// needed, -1 if it can not be framed (too large or chunked body).
+inline long request_length(const std::string& buf)
+{
+    auto header_end = buf.find("\r\n\r\n");
+    if (header_end == std::string::npos) {
+        return buf.size() > CPPHTTPLIB_EVENT_LOOP_MAX_REQUEST_SIZE ? -1 : 0;
+    }
+    header_end += 4;
+
+    size_t content_length = 0;
+    auto pos = buf.find("\r\n");
+    while (pos + 2 < header_end) {
+        auto line = buf.c_str() + pos + 2;
+        if (!strncasecmp(line, "Content-Length:", 15)) {
+            content_length = strtoul(line + 15, nullptr, 10);
+        } else if (!strncasecmp(line, "Transfer-Encoding:", 18)) {
+            return -1;
+        }
+        pos = buf.find("\r\n", pos + 2);
+    }
+
+    auto len = header_end + content_length;
+    if (len > CPPHTTPLIB_EVENT_LOOP_MAX_REQUEST_SIZE) {
+        return -1;
+    }
+    return buf.size() >= len ? static_cast<long>(len) : 0;
+}
+
+// Edge-triggered reactor: this thread accepts, reads and writes every
+// connection without blocking, and a request goes to the pool only once it
+// has been received completely. Idle keep-alive connections therefore cost
+// a buffer each instead of a worker. Responses come back through an
+// eventfd. The reactor never waits for the pool: a request that finds its
+// queue full is answered 503 and its connection closed. Returns when
+// `svr_sock` is set to -1 by Server::stop().
+template <typename T>
+inline bool event_loop(const socket_t& svr_sock, ThreadPool* pool, bool keep_alive, T callback)
+{
+    typedef std::chrono::steady_clock clock;
+
+    struct Connection {
+        socket_t sock;
+        std::string in;         // received, not handled yet
+        std::string out;        // response not sent yet
+        size_t out_pos = 0;
+        int count = 0;          // requests handled so far
+        bool busy = false;      // a worker has the current request
+        bool read_closed = false;
+        bool close_after_write = false;
+        bool broken = false;    // failed while busy, drop the response
+        clock::time_point last_active;
+    };
+    struct Done {
+        socket_t sock;
+        std::string out;
+        bool close;
+    };
+
+    typedef typename std::list<Connection>::iterator conn_iter;
+
+    // Least recently active first, so the idle sweep stops early.
+    std::list<Connection> conns;
+    std::unordered_map<socket_t, conn_iter> conn_map;
+
+    std::mutex done_mutex;
+    std::vector<Done> done;
+
+    auto epfd = epoll_create1(EPOLL_CLOEXEC);
+    auto efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epfd < 0 || efd < 0) {
+        if (epfd >= 0) {
+            close(epfd);
+        }
+        if (efd >= 0) {
+            close(efd);
+        }
+        return false;
+    }
+
+    set_nonblocking(svr_sock, true);
+
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = svr_sock;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, svr_sock, &ev);
+    ev.data.fd = efd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, efd, &ev);
+    auto accepting = true;
+
+    const auto touch = [&](conn_iter it) {
+        it->last_active = clock::now();
+        conns.splice(conns.end(), conns, it);
+    };
+
+    const auto close_conn = [&](conn_iter it) {
+        close_socket(it->sock);
+        conn_map.erase(it->sock);
+        conns.erase(it);
+    };
+
+    const auto finish = [&](socket_t sock, std::string& out, bool close) {
+        {
+            std::unique_lock<std::mutex> lock(done_mutex);
+            done.push_back(Done{sock, std::move(out), close});
+        }
+        uint64_t one = 1;
+        if (write(efd, &one, sizeof(one)) < 0) {
+            ; // the counter is already non-zero
+        }
+    };
+
+    // Sends what the socket takes now, the rest goes on EPOLLOUT. Returns
+    // false if the connection was closed.
+    const auto flush = [&](conn_iter it) {
+        while (it->out_pos < it->out.size()) {
+            auto n = send(it->sock, it->out.data() + it->out_pos,
+                          it->out.size() - it->out_pos, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return true;
+                } else if (errno == EINTR) {
+                    continue;
+                }
+                close_conn(it);
+                return false;
+            }
+            it->out_pos += n;
+        }
+        it->out.clear();
+        it->out_pos = 0;
+        if (it->close_after_write) {
+            close_conn(it);
+            return false;
+        }
+        return true;
+    };
+
+    // Hands the next complete request to a worker, one at a time so that
+    // pipelined responses keep their order.
+    const auto dispatch = [&](conn_iter it) {
+        if (it->busy || !it->out.empty()) {
+            return;
+        }
+        auto len = request_length(it->in);
+        if (len < 0 || (len == 0 && it->read_closed)) {
+            close_conn(it);
+            return;
+        } else if (len == 0) {
+            return;
+        }
+
+        std::string req(it->in, 0, len);
+        it->in.erase(0, len);
+        it->busy = true;
+
+        auto last_connection = !keep_alive ||
+            it->count + 1 >= CPPHTTPLIB_EVENT_LOOP_KEEPALIVE_MAX_COUNT;
+        auto line_end = req.find("\r\n");
+        if (line_end >= 8 && !req.compare(line_end - 8, 8, "HTTP/1.0")) {
+            last_connection = true;
+        }
+
+        auto sock = it->sock;
+        auto job = [&, sock, req, last_connection]() {
+            std::string out;
+            BufferStream strm(req, out);
+            auto ret = callback(strm, last_connection);
+            finish(sock, out, !ret || last_connection);
+        };
+        if (!pool) {
+            job();
+        } else if (!pool->try_enqueue(job)) {
+            it->busy = false;
+            it->in.clear();
+            it->out = keep_alive ? "HTTP/1.1" : "HTTP/1.0";
+            it->out += " 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+            it->close_after_write = true;
+            flush(it);
+        }
+    };
+
+    auto ret = true;
+    auto next_sweep = clock::now() + std::chrono::seconds(1);
+    epoll_event events[CPPHTTPLIB_EVENT_LOOP_MAX_EVENTS];
+
+    while (ret && svr_sock != -1) {
+        auto nfds = epoll_wait(epfd, events, CPPHTTPLIB_EVENT_LOOP_MAX_EVENTS, 100);
+        if (nfds < 0 && errno != EINTR) {
+            ret = false;
+            break;
+        }
+
+        for (int i = 0; i < nfds; i++) {
+            auto fd = events[i].data.fd;
+
+            if (fd == svr_sock) {
+                for (;;) {
+                    socket_t sock = accept4(svr_sock, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                    if (sock == -1) {
+                        if (errno == EMFILE || errno == ENFILE) {
+                            // out of descriptors, retry on the next sweep
+                            epoll_ctl(epfd, EPOLL_CTL_DEL, svr_sock, NULL);
+                            accepting = false;
+                        } else if (errno != EAGAIN && errno != EWOULDBLOCK &&
+                                   errno != EINTR && errno != ECONNABORTED &&
+                                   svr_sock != -1) {
+                            ret = false;
+                        }
+                        break;
+                    }
+
+                    Connection conn;
+                    conn.sock = sock;
+                    conn.last_active = clock::now();
+                    conn_map[sock] = conns.insert(conns.end(), std::move(conn));
+
+                    epoll_event cev;
+                    memset(&cev, 0, sizeof(cev));
+                    cev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+                    cev.data.fd = sock;
+                    epoll_ctl(epfd, EPOLL_CTL_ADD, sock, &cev);
+                }
+                if (!ret) {
+                    break;
+                }
+                continue;
+            }
+
+            if (fd == efd) {
+                uint64_t counter;
+                if (read(efd, &counter, sizeof(counter)) < 0) {
+                    ; // spurious wakeup
+                }
+                std::vector<Done> finished;
+                {
+                    std::unique_lock<std::mutex> lock(done_mutex);
+                    finished.swap(done);
+                }
+                for (auto& d: finished) {
+                    auto it = conn_map[d.sock];
+                    it->busy = false;
+                    it->count++;
+                    if (it->broken) {
+                        close_conn(it);
+                        continue;
+                    }
+                    it->out = std::move(d.out);
+                    it->close_after_write = d.close;
+                    touch(it);
+                    if (flush(it)) {
+                        dispatch(it);
+                    }
+                }
+                continue;
+            }
+
+            auto found = conn_map.find(fd);
+            if (found == conn_map.end()) {
+                continue;
+            }
+            auto it = found->second;
+            auto e = events[i].events;
+
+            if (e & EPOLLERR) {
+                if (it->busy) {
+                    it->broken = true;
+                } else {
+                    close_conn(it);
+                }
+                continue;
+            }
+
+            if (e & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) {
+                char buf[4096];
+                auto alive = true;
+                for (;;) {
+                    auto n = recv(fd, buf, sizeof(buf), 0);
+                    if (n > 0) {
+                        it->in.append(buf, n);
+                        if (it->in.size() > CPPHTTPLIB_EVENT_LOOP_MAX_REQUEST_SIZE) {
+                            alive = false;
+                            break;
+                        }
+                        continue;
+                    } else if (n == 0) {
+                        it->read_closed = true;
+                    } else if (errno == EINTR) {
+                        continue;
+                    } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                        alive = false;
+                    }
+                    break;
+                }
+                if (!alive) {
+                    if (it->busy) {
+                        it->broken = true;
+                    } else {
+                        close_conn(it);
+                    }
+                    continue;
+                }
+                touch(it);
+            }
+
+            if ((e & EPOLLOUT) && !it->out.empty()) {
+                touch(it);
+                if (!flush(it)) {
+                    continue;
+                }
+            }
+            dispatch(it);
+        }
+
+        auto now = clock::now();
+        if (now >= next_sweep) {
+            next_sweep = now + std::chrono::seconds(1);
+            auto deadline = now - std::chrono::seconds(CPPHTTPLIB_EVENT_LOOP_IDLE_TIMEOUT_SECOND);
+            for (auto it = conns.begin(); it != conns.end() && it->last_active < deadline; ) {
+                auto cur = it++;
+                if (!cur->busy) {
+                    close_conn(cur);
+                }
+            }
+            if (!accepting && svr_sock != -1) {
+                memset(&ev, 0, sizeof(ev));
+                ev.events = EPOLLIN;
+                ev.data.fd = svr_sock;
+                accepting = epoll_ctl(epfd, EPOLL_CTL_ADD, svr_sock, &ev) == 0;
+            }
+        }
+    }
+
+    // The jobs still queued write to `done`, finish them first.
+    if (pool) {
+        pool->shutdown();
+    }
+
+    for (auto& conn: conns) {
+        close_socket(conn.sock);
+    }
+    close(efd);
+    close(epfd);
+
+    return ret;
+}
+#endif
+
 inline bool is_file(const std::string& path)
 {
     struct stat st;
@@ -634,10 +1194,13 @@ inline void read_file(const std::string& path, std::string& out)
 
 inline std::string file_extension(const std::string& path)
 {
-    std::smatch m;
-    auto pat = std::regex("\\.([a-zA-Z0-9]+)$");
-    if (std::regex_search(path, m, pat)) {
-        return m[1].str();
+    auto e = path.size();
+    auto b = e;
+    while (b > 0 && isalnum(static_cast<unsigned char>(path[b - 1]))) {
+        b--;
+    }
+    if (b < e && b > 0 && path[b - 1] == '.') {
+        return path.substr(b);
     }
     return std::string();
 }
@@ -704,10 +1267,51 @@ inline int get_header_value_int(const Headers& headers, const char* key, int def
     return def;
 }
 
-inline bool read_headers(Stream& strm, Headers& headers)
+inline bool is_header_space(char c)
 {
-    static std::regex re(R"((.+?):\s*(.+?)\s*\r\n)");
+    return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+}
+
+// "Key: value\r\n", the value without surrounding white space. Lines that
+// do not have this form are skipped by the caller. As with the regex this
+// replaced, the key ends at the first colon that is not its first byte and
+// leaves a value without '\r'.
+inline bool parse_header(const char* b, const char* e, string_ref& key, string_ref& val)
+{
+    if (e - b < 3 || e[-2] != '\r' || e[-1] != '\n') {
+        return false;
+    }
+    e -= 2;
+
+    for (auto colon = b + 1; (colon = static_cast<const char*>(memchr(colon, ':', e - colon))); ++colon) {
+        if (memchr(b, '\r', colon - b)) {
+            return false;
+        }
+
+        auto vb = colon + 1;
+        auto ve = e;
+        while (vb < ve && is_header_space(*vb)) {
+            vb++;
+        }
+        while (ve > vb && is_header_space(ve[-1])) {
+            ve--;
+        }
+        if (vb == ve) {
+            return false;
+        }
+        if (memchr(vb, '\r', ve - vb)) {
+            continue;
+        }
 
+        key = string_ref(b, colon);
+        val = string_ref(vb, ve);
+        return true;
+    }
+    return false;
+}
+
+inline bool read_headers(Stream& strm, Headers& headers)
+{
     const auto bufsiz = 2048;
     char buf[bufsiz];
 
@@ -720,11 +1324,9 @@ inline bool read_headers(Stream& strm, Headers& headers)
         if (!strcmp(reader.ptr(), "\r\n")) {
             break;
         }
-        std::cmatch m;
-        if (std::regex_match(reader.ptr(), m, re)) {
-            auto key = std::string(m[1]);
-            auto val = std::string(m[2]);
-            headers.emplace(key, val);
+        string_ref key, val;
+        if (parse_header(reader.ptr(), reader.ptr() + reader.size(), key, val)) {
+            headers.emplace(key.str(), val.str());
         }
     }
 
@@ -883,15 +1485,15 @@ inline bool is_hex(char c, int& v)
     return false;
 }
 
-inline bool from_hex_to_i(const std::string& s, int i, int cnt, int& val)
+inline bool from_hex_to_i(const char* p, const char* e, int cnt, int& val)
 {
     val = 0;
-    for (; cnt; i++, cnt--) {
-        if (!s[i]) {
+    for (; cnt; p++, cnt--) {
+        if (p == e || !*p) {
             return false;
         }
         int v = 0;
-        if (is_hex(s[i], v)) {
+        if (is_hex(*p, v)) {
             val = val * 16 + v;
         } else {
             return false;
@@ -933,48 +1535,54 @@ inline size_t to_utf8(int code, char* buff)
     return 0;
 }
 
-inline std::string decode_url(const std::string& s)
+inline std::string decode_url(const char* b, const char* e)
 {
     std::string result;
+    result.reserve(e - b);
 
-    for (int i = 0; s[i]; i++) {
-        if (s[i] == '%') {
-            if (s[i + 1] && s[i + 1] == 'u') {
+    for (auto s = b; s != e && *s; s++) {
+        if (*s == '%') {
+            if (s + 1 != e && s[1] == 'u') {
                 int val = 0;
-                if (from_hex_to_i(s, i + 2, 4, val)) {
+                if (from_hex_to_i(s + 2, e, 4, val)) {
                     // 4 digits Unicode codes
                     char buff[4];
                     size_t len = to_utf8(val, buff);
                     if (len > 0) {
                         result.append(buff, len);
                     }
-                    i += 5; // 'u0000'
+                    s += 5; // 'u0000'
                 } else {
-                    result += s[i];
+                    result += *s;
                 }
             } else {
                 int val = 0;
-                if (from_hex_to_i(s, i + 1, 2, val)) {
+                if (from_hex_to_i(s + 1, e, 2, val)) {
                     // 2 digits hex codes
                     result += val;
-                    i += 2; // '00'
+                    s += 2; // '00'
                 } else {
-                    result += s[i];
+                    result += *s;
                 }
             }
-        } else if (s[i] == '+') {
+        } else if (*s == '+') {
             result += ' ';
         } else {
-            result += s[i];
+            result += *s;
         }
     }
 
     return result;
 }
 
-inline void parse_query_text(const std::string& s, Params& params)
+inline std::string decode_url(const std::string& s)
+{
+    return decode_url(s.data(), s.data() + s.size());
+}
+
+inline void parse_query_text(const char* b, const char* e, Params& params)
 {
-    split(&s[0], &s[s.size()], '&', [&](const char* b, const char* e) {
+    split(b, e, '&', [&](const char* b, const char* e) {
         std::string key;
         std::string val;
         split(b, e, '=', [&](const char* b, const char* e) {
@@ -988,6 +1596,11 @@ inline void parse_query_text(const std::string& s, Params& params)
     });
 }
 
+inline void parse_query_text(const std::string& s, Params& params)
+{
+    parse_query_text(s.data(), s.data() + s.size(), params);
+}
+
 inline bool parse_multipart_boundary(const std::string& content_type, std::string& boundary)
 {
     auto pos = content_type.find("boundary=");
@@ -1329,10 +1942,42 @@ inline int SocketStream::write(const char* ptr)
     return write(ptr, strlen(ptr));
 }
 
+// Buffer stream implementation
+inline BufferStream::BufferStream(const std::string& in, std::string& out)
+    : in_(in), pos_(0), out_(out)
+{
+}
+
+inline BufferStream::~BufferStream()
+{
+}
+
+inline int BufferStream::read(char* ptr, size_t size)
+{
+    size = std::min(size, in_.size() - pos_);
+    memcpy(ptr, in_.data() + pos_, size);
+    pos_ += size;
+    return static_cast<int>(size);
+}
+
+inline int BufferStream::write(const char* ptr, size_t size)
+{
+    out_.append(ptr, size);
+    return static_cast<int>(size);
+}
+
+inline int BufferStream::write(const char* ptr)
+{
+    return write(ptr, strlen(ptr));
+}
+
 // HTTP server implementation
 inline Server::Server(HttpVersion http_version)
     : http_version_(http_version)
     , svr_sock_(-1)
+    , thread_count_(0)
+    , queue_limit_(0)
+    , event_loop_(false)
 {
 #ifndef _WIN32
     signal(SIGPIPE, SIG_IGN);
@@ -1343,15 +1988,27 @@ inline Server::~Server()
 {
 }
 
+inline void Server::add_route(Handlers& handlers, const char* pattern, Handler handler)
+{
+    Route route;
+    if (strpbrk(pattern, ".[]{}()\\*+?|^$")) {
+        route.pattern.reset(new std::regex(pattern));
+    } else {
+        route.path = pattern;
+    }
+    route.handler = handler;
+    handlers.push_back(std::move(route));
+}
+
 inline Server& Server::get(const char* pattern, Handler handler)
 {
-    get_handlers_.push_back(std::make_pair(std::regex(pattern), handler));
+    add_route(get_handlers_, pattern, handler);
     return *this;
 }
 
 inline Server& Server::post(const char* pattern, Handler handler)
 {
-    post_handlers_.push_back(std::make_pair(std::regex(pattern), handler));
+    add_route(post_handlers_, pattern, handler);
     return *this;
 }
 
@@ -1374,6 +2031,23 @@ inline void Server::set_logger(Logger logger)
     logger_ = logger;
 }
 
+inline void Server::set_thread_count(size_t thread_count, size_t queue_limit)
+{
+    thread_count_ = thread_count;
+    queue_limit_ = queue_limit ? queue_limit : thread_count * CPPHTTPLIB_THREAD_POOL_QUEUE_PER_THREAD;
+}
+
+inline bool Server::set_event_loop(bool on)
+{
+#ifdef __linux__
+    event_loop_ = on;
+    return true;
+#else
+    event_loop_ = false;
+    return !on;
+#endif
+}
+
 inline bool Server::listen(const char* host, int port, int socket_flags)
 {
     if (!is_valid()) {
@@ -1387,6 +2061,25 @@ inline bool Server::listen(const char* host, int port, int socket_flags)
 
     auto ret = true;
 
+    std::unique_ptr<ThreadPool> pool;
+    if (thread_count_ > 0) {
+        pool.reset(new ThreadPool(thread_count_, queue_limit_));
+    }
+
+#ifdef __linux__
+    if (event_loop_) {
+        auto keep_alive = http_version_ == HttpVersion::v1_1;
+
+        return detail::event_loop(
+            svr_sock_,
+            pool.get(),
+            keep_alive,
+            [this](Stream& strm, bool last_connection) {
+                return process_request(strm, last_connection);
+            });
+    }
+#endif
+
     for (;;) {
         auto val = detail::select_read(svr_sock_, 0, 100000);
 
@@ -1410,12 +2103,18 @@ inline bool Server::listen(const char* host, int port, int socket_flags)
             break;
         }
 
-        // TODO: Use thread pool...
-        //std::thread([=]() {
+        if (pool) {
+            if (!pool->enqueue([=]() { read_and_close_socket(sock); })) {
+                detail::close_socket(sock);
+            }
+        } else {
             read_and_close_socket(sock);
-        //}).detach();
+        }
     }
 
+    // Let the workers finish the connections already accepted.
+    pool.reset();
+
     return ret;
 }
 
@@ -1431,26 +2130,23 @@ inline void Server::stop()
     svr_sock_ = -1;
 }
 
-inline bool Server::parse_request_line(const char* s, Request& req)
+inline bool Server::parse_request_line(const char* s, size_t len, Request& req)
 {
-    static std::regex re("(GET|HEAD|POST) ([^?]+)(?:\\?(.+?))? (HTTP/1\\.[01])\r\n");
-
-    std::cmatch m;
-    if (std::regex_match(s, m, re)) {
-        req.version = std::string(m[4]);
-        req.method = std::string(m[1]);
-        req.path = detail::decode_url(m[2]);
+    detail::request_line rl;
+    if (!detail::parse_request_line(s, s + len, rl)) {
+        return false;
+    }
 
-        // Parse query text
-        auto len = std::distance(m[3].first, m[3].second);
-        if (len > 0) {
-            detail::parse_query_text(m[3], req.params);
-        }
+    req.version.assign(rl.version.b, rl.version.e);
+    req.method.assign(rl.method.b, rl.method.e);
+    req.path = detail::decode_url(rl.path.b, rl.path.e);
 
-        return true;
+    // Parse query text
+    if (!rl.query.empty()) {
+        detail::parse_query_text(rl.query.b, rl.query.e, req.params);
     }
 
-    return false;
+    return true;
 }
 
 inline void Server::write_response(Stream& strm, bool last_connection, const Request& req, Response& res)
@@ -1483,6 +2179,9 @@ inline void Server::write_response(Stream& strm, bool last_connection, const Req
 
         auto length = httplib_to_string(res.body.size());
         res.set_header("Content-Length", length.c_str());
+    } else if (res.get_header_value("Connection") != "close") {
+        // a kept-alive client can not tell where an empty body ends otherwise
+        res.set_header("Content-Length", "0");
     }
 
     detail::write_headers(strm, res);
@@ -1528,7 +2227,7 @@ inline socket_t Server::create_server_socket(const char* host, int port, int soc
             if (::bind(sock, ai.ai_addr, ai.ai_addrlen)) {
                   return false;
             }
-            if (::listen(sock, 5)) { // Listen through 5 channels
+            if (::listen(sock, CPPHTTPLIB_LISTEN_BACKLOG)) {
                 return false;
             }
             return true;
@@ -1552,11 +2251,8 @@ inline bool Server::routing(Request& req, Response& res)
 inline bool Server::dispatch_request(Request& req, Response& res, Handlers& handlers)
 {
     for (const auto& x: handlers) {
-        const auto& pattern = x.first;
-        const auto& handler = x.second;
-
-        if (std::regex_match(req.path, req.matches, pattern)) {
-            handler(req, res);
+        if (x.pattern ? std::regex_match(req.path, req.matches, *x.pattern) : req.path == x.path) {
+            x.handler(req, res);
             return true;
         }
     }
@@ -1581,7 +2277,7 @@ inline bool Server::process_request(Stream& strm, bool last_connection)
     res.version = detail::http_version_strings[static_cast<size_t>(http_version_)];
 
     // Request line and headers
-    if (!parse_request_line(reader.ptr(), req) || !detail::read_headers(strm, req.headers)) {
+    if (!parse_request_line(reader.ptr(), reader.size(), req) || !detail::read_headers(strm, req.headers)) {
         res.status = 400;
         write_response(strm, last_connection, req, res);
         return true;
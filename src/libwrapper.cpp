@@ -22,12 +22,14 @@
 #include "config.h"
 #endif
 
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 #include <map>
 #include <unordered_map>
 #include <memory>
 
+#include "metrics.hpp"
 #include "utils.hpp"
 #include "libwrapper.hpp"
 
@@ -62,32 +64,62 @@ void TransAction::constructString(char *str, bool isFrom)
         str = varend + 2;
     }
 }
-std::string TransformatTemplate::generate(const CBook_it &dictname, const char *xstr, char sametypesequence, uint32_t &sec_size)
+std::string TransformatTemplate::generate(const CBook_it &dictname, const char *xstr, size_t len, char sametypesequence) const
 {
-    std::string res(xstr);
-    sec_size = res.length();
+    StageTimer timer(msTRANSFORM);
+    std::string res(xstr, len);
     const std::map<char, CustomType>::const_iterator rep = customRep.find(sametypesequence);
     if (rep != customRep.end()) {
-        const auto &getter = [&dictname](const std::string &name)->std::string {
-            if (name == "DICT_PATH") {
-                return dictname->second;
-            } else if (name == "DICT_NAME") {
-                return dictname->first;
-            }
-            return "";
-        };
+        const VMaper getter = TransAction::dictVars(dictname);
         for (const auto &it : rep->second) {
             it->replaceAll(res, getter);
         }
     }
     return res;
 }
-TransformatTemplate::TransformatTemplate(const char *fileName)
+// whether a non-empty proper suffix of a is a prefix of b: an occurrence
+// of b can then start inside one of a and go on past its end.
+static bool suffix_is_prefix(const std::string &a, const std::string &b)
+{
+    if (a.empty())
+        return false;
+    for (size_t len = std::min(a.size(), b.size() + 1) - 1; len > 0; --len)
+        if (a.compare(a.size() - len, len, b, 0, len) == 0)
+            return true;
+    return false;
+}
+// whether an occurrence of b can share a byte with one of a: one holds the
+// other, or they overlap at an end. Never for an empty a.
+static bool can_share_text(const std::string &a, const std::string &b)
+{
+    if (a.empty())
+        return false;
+    return a.find(b) != std::string::npos || b.find(a) != std::string::npos ||
+           suffix_is_prefix(a, b) || suffix_is_prefix(b, a);
+}
+TransActTextSet::conflict_t TransActTextSet::conflict(const std::string &f, std::string *with) const
+{
+    for (size_t i = 0; i < patterns.size(); ++i) {
+        *with = patterns[i];
+        // one by one, the earlier rule may change what f would match, or
+        // write something f matches.
+        if (can_share_text(patterns[i], f) || can_share_text(replacements[i], f))
+            return cfOVERLAP;
+        // deleting a match brings the text on both sides of it together,
+        // which f can then match across unless it is a single byte.
+        if (replacements[i].empty() && f.size() > 1)
+            return cfJOIN;
+    }
+    return cfNONE;
+}
+TransformatTemplate::TransformatTemplate(const char *fileName, const std::map<std::string, std::string> &books)
 {
     char *content = g_file_get_contents(fileName);
     // file format
     // dict type declaration:
     // :{{sametypesequence}}
+    // or, to convert the XDXF tags with the built-in converter first:
+    // :{{sametypesequence}} native
     // plain text replace:
     // x=y
     // regular expression replace:
@@ -103,6 +135,8 @@ TransformatTemplate::TransformatTemplate(const char *fileName)
                 continue;
             } else if (':' == *p) {
                 sametypesequence = *++p;
+                if (sametypesequence && strcmp(p + 1, " native") == 0)
+                    customRep[sametypesequence].push_back(std::unique_ptr<TransAction>(new TransActXdxf));
                 continue;
             }
             char *eq = nullptr;
@@ -156,12 +190,29 @@ TransformatTemplate::TransformatTemplate(const char *fileName)
                 }
                 TransAction *transact(nullptr);
                 switch (exprFlag) {
-                case '=':
-                    transact = (new TransActText(p, eq));
+                case '=': {
+                    std::unique_ptr<TransActText> text(new TransActText(p, eq));
+                    std::string f, t, with;
+                    if (!text->literal(f, t) || f.empty()) {
+                        transact = text.release();
+                        break;
+                    }
+                    // join the rules before it if they do not interfere.
+                    auto *set = it->second.empty() ? nullptr : dynamic_cast<TransActTextSet *>(it->second.back().get());
+                    const TransActTextSet::conflict_t cf = set ? set->conflict(f, &with) : TransActTextSet::cfNONE;
+                    if (cf == TransActTextSet::cfOVERLAP)
+                        fprintf(stderr, "%s: rule \"%s\" of :%c overlaps the earlier \"%s\", applying it in a later pass\n",
+                                fileName, f.c_str(), sametypesequence, with.c_str());
+                    if (!set || cf != TransActTextSet::cfNONE) {
+                        set = new TransActTextSet;
+                        transact = set;
+                    }
+                    set->add(f, t);
                     break;
+                }
                 case '~':
                     //regex
-                    transact = (new TransActRegex(p, eq));
+                    transact = (new TransActRegex(p, eq, books));
                     break;
                 }
                 if (transact != nullptr)
@@ -170,31 +221,18 @@ TransformatTemplate::TransformatTemplate(const char *fileName)
         }
     }
     free(content);
+    for (auto &rep : customRep)
+        for (auto &act : rep.second)
+            if (auto *set = dynamic_cast<TransActTextSet *>(act.get()))
+                set->build();
 }
 
-static VMaper forFunc(const TSearchResultList::iterator &it, int i,const VMaper &m)
-{
-    return [&it,i,&m](const std::string &key)->std::string {
-        char num[12];
-        switch (key[0]) {
-        case 'i':
-            snprintf(num, sizeof(num), "%d", i);
-            return std::string(num);
-        case 'w':
-            return it->word;
-        case 'd':
-            return it->definition;
-        case 'b':
-            return it->bookname;
-        }
-        return m(key);
-    };
-}
 ResponseOut::ResponseOut(const char *fileName)
 {
     char *buffer = g_file_get_contents(fileName);
     char *content, *varstart, *varend, *varcol;
-    char stateflag = 0, marker = 0;
+    int stateflag = 0;
+    char marker = 0;
     // file format
     // out type declaration:
     // {{m:h}}
@@ -216,25 +254,54 @@ ResponseOut::ResponseOut(const char *fileName)
         printf("no output template\n");
         exit(3);
     }
-    const auto &pusher = [this](TemplateHolder *th, char stateflag) {
+    // the opFOR whose body is being read.
+    size_t loop = 0;
+    bool inloop = false;
+    const auto &endloop = [this, &loop, &inloop]() {
+        if (inloop)
+            ops[loop].a = ops.size();
+        inloop = false;
+    };
+    const auto &pushtext = [this](const char *s) {
+        const size_t len = strlen(s);
+        if (len > 0) {
+            ops.push_back(TemplateOp{TemplateOp::opTEXT, uint32_t(text.size()), uint32_t(len)});
+            text.append(s, len);
+        }
+    };
+    const auto &pushvar = [this, &stateflag, &marker](const char *name) {
+        TemplateOp::var_t var = TemplateOp::vNONE;
         if (stateflag > 0) {
-            static_cast<ForHolder<TSearchResultList, TSearchResultList::iterator>*>(elements.back())->addHolder(th);
-        } else {
-            elements.push_back(th);
+            switch (name[0]) {
+            case 'i':
+                var = TemplateOp::vINDEX;
+                break;
+            case 'w':
+                var = TemplateOp::vWORD;
+                break;
+            case 'd':
+                var = TemplateOp::vDEFINITION;
+                break;
+            case 'b':
+                var = TemplateOp::vBOOKNAME;
+                break;
+            }
         }
+        if (var == TemplateOp::vNONE && strcmp(name, "str") == 0)
+            var = TemplateOp::vSTR;
+        if (var != TemplateOp::vNONE)
+            ops.push_back(TemplateOp{TemplateOp::opVAR, var, marker == 'j'});
     };
     content = buffer;
     while (*content) {
         varstart = strstr(content, "{{");
         if (nullptr == varstart) {
-            pusher(new TextHolder(content, 0, marker), stateflag);
+            pushtext(content);
             break;
         }
         *varstart = '\0';
         varstart += 2;
-        if (varstart > content) {
-            pusher(new TextHolder(content, 0, marker), stateflag);
-        }
+        pushtext(content);
         varend = strstr(varstart, "}}");
         if (nullptr == varend) {
             printf("ERROR parsing %s\n", varstart);
@@ -246,59 +313,138 @@ ResponseOut::ResponseOut(const char *fileName)
         if (varcol) {
             *varcol = '\0';
             ++varcol;
+            // a loop shows only its text and variables, nested loops are empty.
             if (*varstart == 'm') {
                 marker = *varcol;
-                pusher(new MarkerHolder(marker), stateflag);
+                if (stateflag <= 0)
+                    ops.push_back(TemplateOp{TemplateOp::opMARKER, uint32_t(marker), 0});
             } else if (0 == strncmp(varstart, "for", 4)) {
-                pusher(new ForHolder<TSearchResultList, TSearchResultList::iterator>(forFunc), stateflag);
-                ++stateflag;
+                if (stateflag <= 0) {
+                    loop = ops.size();
+                    ops.push_back(TemplateOp{TemplateOp::opFOR, 0, 0});
+                    inloop = true;
+                }
+                if (++stateflag <= 0)
+                    endloop();
             } else if (0 == strncmp(varstart, "endfor", 7)) {
-                --stateflag;
+                if (--stateflag <= 0)
+                    endloop();
             }
         } else {
-            pusher(new TextHolder(varstart, 1, marker), stateflag);
+            pushvar(varstart);
         }
         content = varend + 2;
     }
+    endloop();
     free(buffer);
 }
-void ResponseOut::make_content(bool isWrap, TSearchResultList &res_list, const char *str)
+
+static void append_var(std::string &out, const TemplateOp &op, const TSearchResult *r, int idx, const char *str)
 {
-    const auto &wrapgetter = [&str](const std::string &key)->std::string {
-        if (str && key == "str")
-            return std::string(str);
-        return "";
-    };
-    bool outFlag = true;
+    char num[12];
+    const char *s = "";
+    size_t len = 0;
+    switch (op.a) {
+    case TemplateOp::vSTR:
+        if (str) {
+            s = str;
+            len = strlen(str);
+        }
+        break;
+    case TemplateOp::vINDEX:
+        len = snprintf(num, sizeof(num), "%d", idx);
+        s = num;
+        break;
+    case TemplateOp::vWORD:
+        s = r->word.data();
+        len = r->word.size();
+        break;
+    case TemplateOp::vBOOKNAME:
+        s = r->bookname.data();
+        len = r->bookname.size();
+        break;
+    case TemplateOp::vDEFINITION:
+        s = r->definition.data();
+        len = r->definition.size();
+        break;
+    }
+    if (op.b)
+        json_escape_string(s, len, out);
+    else
+        out.append(s, len);
+}
+std::string ResponseOut::make_content(bool isWrap, const TSearchResultList &res_list, const char *str) const
+{
+    StageTimer timer(msMAKE_CONTENT);
+    // about the size of the output, so that it is allocated once.
+    size_t fields[TemplateOp::vDEFINITION + 1] = {0};
+    fields[TemplateOp::vSTR] = str ? strlen(str) : 0;
+    for (const auto &r : res_list) {
+        fields[TemplateOp::vINDEX] += 4;
+        fields[TemplateOp::vWORD] += r.word.size();
+        fields[TemplateOp::vBOOKNAME] += r.bookname.size();
+        fields[TemplateOp::vDEFINITION] += r.definition.size();
+    }
+    size_t size = 0;
+    for (size_t i = 0, end = ops.size(), n = 1; i < ops.size(); ++i) {
+        if (i == end)
+            n = 1;
+        if (ops[i].op == TemplateOp::opFOR) {
+            end = ops[i].a;
+            n = res_list.size();
+        } else if (ops[i].op == TemplateOp::opTEXT) {
+            size += n * ops[i].b;
+        } else if (ops[i].op == TemplateOp::opVAR) {
+            size += ops[i].a == TemplateOp::vSTR ? n * fields[TemplateOp::vSTR] : fields[ops[i].a];
+        }
+    }
+    std::string buffer;
+    buffer.reserve(size);
 
-    for (auto &elem: elements) {
-        if (elem->holderType == 'M') {
-            if (!isWrap && static_cast<const MarkerHolder*>(elem)->flag != 'b') {
-                outFlag = false;
-            } else {
-                outFlag = true;
-            }
-        } else if (outFlag) {
-            if (elem->holderType == 'T') {
-                buffer += elem->toString(wrapgetter);
-            } else if (elem->holderType == 'F') {
-                auto *fh = static_cast<ForHolder<TSearchResultList, TSearchResultList::iterator>*>(elem);
-                fh->obj = &res_list;
-                buffer += elem->toString(wrapgetter);
+    bool outFlag = true;
+    for (size_t i = 0; i < ops.size(); ++i) {
+        const TemplateOp &op = ops[i];
+        switch (op.op) {
+        case TemplateOp::opMARKER:
+            outFlag = isWrap || op.a == 'b';
+            break;
+        case TemplateOp::opTEXT:
+            if (outFlag)
+                buffer.append(text, op.a, op.b);
+            break;
+        case TemplateOp::opVAR:
+            if (outFlag)
+                append_var(buffer, op, nullptr, 0, str);
+            break;
+        case TemplateOp::opFOR:
+            if (outFlag) {
+                int idx = 0;
+                for (const auto &r : res_list) {
+                    ++idx;
+                    for (size_t j = i + 1; j < op.a; ++j) {
+                        if (ops[j].op == TemplateOp::opTEXT)
+                            buffer.append(text, ops[j].a, ops[j].b);
+                        else
+                            append_var(buffer, ops[j], &r, idx, str);
+                    }
+                }
             }
+            i = op.a - 1;
+            break;
         }
     }
+    return buffer;
 }
 
-const std::string Library::process_phrase(const char *str, bool alldata)
+const std::string Library::process_phrase(const char *str, bool alldata) const
 {
     TSearchResultList res_list;
-    rout.reset();
     if (nullptr == str || '\0' == str[0]) {
-        rout.make_content(alldata, res_list, str);
-        return rout.get_content();
+        return rout.make_content(alldata, res_list, str);
     }
 
+    QueryContext ctx(ndicts(), word_cache(), chunk_cache());
+
     std::string query;
 
     //analyze_query(str, query);
@@ -319,46 +465,51 @@ const std::string Library::process_phrase(const char *str, bool alldata)
 //    }
 
 
-    switch (analyze_query(str, query)) {
+    query_t qtype;
+    {
+        StageTimer timer(msANALYZE_QUERY);
+        qtype = analyze_query(str, query);
+    }
+    Metrics::instance().count_query(qtype);
+    switch (qtype) {
     case qtFUZZY:
-        LookupWithFuzzy(query, res_list);
+        LookupWithFuzzy(query, res_list, ctx);
         break;
     case qtREGEXP:
-        LookupWithRule(query, res_list);
+        LookupWithRule(query, res_list, ctx);
         break;
     case qtSIMPLE:
-        SimpleLookup(query, res_list);
+        SimpleLookup(query, res_list, ctx);
         if (res_list.empty() && !param_.no_fuzzy)
-            LookupWithFuzzy(str, res_list);
+            LookupWithFuzzy(str, res_list, ctx);
         break;
     case qtDATA:
-        LookupData(query, res_list);
+        LookupData(query, res_list, ctx);
         break;
     default:
         /*nothing*/;
     }
 
-    rout.make_content(alldata, res_list, str);
-
-    return rout.get_content();
+    return rout.make_content(alldata, res_list, str);
 }
-const std::string Library::get_neighbour(const char *str, int offset, uint32_t length)
+const std::string Library::get_neighbour(const char *str, int offset, uint32_t length) const
 {
     std::list<std::string> neighbour;
     if (nullptr == str || '\0' == str[0])
         return "";
 
+    QueryContext ctx(ndicts(), word_cache(), chunk_cache());
     int32_t *icurr = (int32_t*)malloc(sizeof(int32_t) * ndicts());
     const char *word;
 
-    poGetNextWord(str, icurr);
+    poGetNextWord(str, icurr, ctx);
     while (++offset <= 2) {
-        word = poGetPreWord(icurr);
+        word = poGetPreWord(icurr, ctx);
         if (!word)
             break;
     }
     while (neighbour.size() < length) {
-        word = poGetNextWord(nullptr, icurr);
+        word = poGetNextWord(nullptr, icurr, ctx);
         if (word)
             neighbour.push_back(word);
         else
@@ -376,17 +527,15 @@ const std::string Library::get_neighbour(const char *str, int offset, uint32_t l
     return result;
 }
 
-std::string Library::parse_data(const CBook_it &dictname, const char *data)
+std::string Library::parse_data(const CBook_it &dictname, const WordData &data) const
 {
     if (!data)
         return "";
 
     std::string res;
-    uint32_t data_size, sec_size;
-    const char *p = data;
-    data_size = get_uint32(p);
-    p += sizeof(uint32_t);
-    while (uint32_t(p - data) < data_size) {
+    size_t sec_size;
+    const char *p = data.fields, *end = data.fields + data.size;
+    while (p < end) {
         const char t = *p++;
         sec_size = 0;
         switch (t) {
@@ -402,69 +551,84 @@ std::string Library::parse_data(const CBook_it &dictname, const char *data)
         case 'k': // KingSoft PowerWord data
         case 'y': // chinese YinBiao or japanese kana, utf-8
 
-            if (*p) {
-                res += transformatter.generate(dictname, p, t, sec_size);
+            sec_size = strnlen(p, end - p);
+            if (sec_size) {
+                res += transformatter.generate(dictname, p, sec_size, t);
             }
             sec_size++;
             break;
         case 'W': // wav file
         case 'P': // picture data
-            sec_size = get_uint32(p);
-            sec_size += sizeof(uint32_t);
+            sec_size = end - p < ptrdiff_t(sizeof(uint32_t)) ? end - p : get_uint32(p) + sizeof(uint32_t);
             break;
         }
+        if (sec_size > size_t(end - p))
+            break;
         p += sec_size;
     }
 
     return res;
 }
 
-void Library::SimpleLookup(const std::string &str, TSearchResultList &res_list)
+void Library::SimpleLookup(const std::string &str, TSearchResultList &res_list, QueryContext &ctx) const
 {
+    StageTimer timer(msSIMPLE_LOOKUP);
     int32_t ind;
     res_list.reserve(ndicts());
     for (int idict = 0; idict < ndicts(); ++idict)
-        if (SimpleLookupWord(str.c_str(), ind, idict))
+        if (SimpleLookupWord(str.c_str(), ind, idict, ctx)) {
+            const WordData data = poGetWordData(ind, idict, ctx);
             res_list.push_back(
                 TSearchResult(dict_name(idict),
-                              poGetWord(ind, idict),
-                              parse_data(bookname_to_path.find(dict_name(idict)), poGetWordData(ind, idict))));
+                              poGetWord(ind, idict, ctx),
+                              parse_data(bookname_to_path.find(dict_name(idict)), data)));
+        }
 }
 
-void Library::LookupWithFuzzy(const std::string &str, TSearchResultList &res_list)
+void Library::LookupWithFuzzy(const std::string &str, TSearchResultList &res_list, QueryContext &ctx) const
 {
     static const int MAXFUZZY = 10;
 
     char *fuzzy_res[MAXFUZZY];
-    if (!Libs::LookupWithFuzzy(str.c_str(), fuzzy_res, MAXFUZZY))
-        return;
+    {
+        StageTimer timer(msFUZZY_LOOKUP);
+        if (!Libs::LookupWithFuzzy(str.c_str(), fuzzy_res, MAXFUZZY, ctx))
+            return;
+    }
 
     for (char **p = fuzzy_res, **end = (fuzzy_res + MAXFUZZY); p != end && *p; ++p) {
-        SimpleLookup(*p, res_list);
+        SimpleLookup(*p, res_list, ctx);
         free(*p);
     }
 }
-void Library::LookupWithRule(const std::string &str, TSearchResultList &res_list)
+void Library::LookupWithRule(const std::string &str, TSearchResultList &res_list, QueryContext &ctx) const
 {
     std::vector<char *> match_res((MAX_MATCH_ITEM_PER_LIB)*ndicts());
 
-    const int nfound = Libs::LookupWithRule(str.c_str(), &match_res[0]);
+    int nfound;
+    {
+        StageTimer timer(msRULE_LOOKUP);
+        nfound = Libs::LookupWithRule(str.c_str(), &match_res[0], ctx);
+    }
     if (nfound == 0)
         return;
 
     for (int i = 0; i < nfound; ++i) {
-        SimpleLookup(match_res[i], res_list);
+        SimpleLookup(match_res[i], res_list, ctx);
         free(match_res[i]);
     }
 }
-void Library::LookupData(const std::string &str, TSearchResultList &res_list)
+void Library::LookupData(const std::string &str, TSearchResultList &res_list, QueryContext &ctx) const
 {
     std::vector<std::vector<char *>> drl(ndicts());
-    if (!Libs::LookupData(str.c_str(), &drl[0]))
-        return;
+    {
+        StageTimer timer(msDATA_LOOKUP);
+        if (!Libs::LookupData(str.c_str(), &drl[0], ctx))
+            return;
+    }
     for (int idict = 0; idict < ndicts(); ++idict)
         for (char *res : drl[idict]) {
-            SimpleLookup(res, res_list);
+            SimpleLookup(res, res_list, ctx);
             free(res);
         }
 }
@@ -1,12 +1,16 @@
 #pragma once
 
+#include <regex>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 #include <cctype>
 
+#include "aho_corasick.hpp"
 #include "stardict_lib.hpp"
 #include "utils.hpp"
+#include "xdxf.hpp"
 
 //this structure is wrapper and it need for unification
 //results of search whith return Dicts class
@@ -59,7 +63,18 @@ public:
     TransAction(TransAction&) = delete;
     TransAction(TransAction&&) = delete;
     virtual ~TransAction(){}
-    virtual void replaceAll(std::string &input, const VMaper &params) = 0;
+    virtual void replaceAll(std::string &input, const VMaper &params) const = 0;
+    // {{DICT_NAME}} and {{DICT_PATH}} of a book.
+    static VMaper dictVars(const CBook_it &dictname) {
+        return [dictname](const std::string &name)->std::string {
+            if (name == "DICT_PATH") {
+                return dictname->second;
+            } else if (name == "DICT_NAME") {
+                return dictname->first;
+            }
+            return "";
+        };
+    }
 protected:
     void constructString(char *str, bool isFrom);
     static std::string genFormatText(const std::list<VarString> &strs, const VMaper &params) {
@@ -79,7 +94,7 @@ public:
         constructString(f, true);
         constructString(t, false);
     }
-    void replaceAll(std::string &input, const VMaper &params) override {
+    void replaceAll(std::string &input, const VMaper &params) const override {
         std::string f = genFormatText(from, params);
         std::string t = genFormatText(to, params);
         std::string::size_type fpos = 0;
@@ -88,10 +103,54 @@ public:
             fpos += t.length();
         }
     }
+    // gets the text of both sides when neither contains a variable.
+    bool literal(std::string &f, std::string &t) const {
+        for (const auto &v : from)
+            if (v.flag)
+                return false;
+        for (const auto &v : to)
+            if (v.flag)
+                return false;
+        f = genFormatText(from, VMaper());
+        t = genFormatText(to, VMaper());
+        return true;
+    }
+};
+// Consecutive plain text rules without variables, applied in one pass over
+// the input. Only rules that cannot see each other's matches or output are
+// put together, so the result is the same as applying them one by one.
+class TransActTextSet: public TransAction {
+public:
+    enum conflict_t {
+        cfNONE,
+        cfOVERLAP,// f can match text another rule matches or writes.
+        cfJOIN,// an earlier rule deletes text, which may join f's halves.
+    };
+    // cfNONE when f=t can join the set, otherwise the first rule in the way.
+    conflict_t conflict(const std::string &f, std::string *with) const;
+    void add(const std::string &f, const std::string &t) {
+        patterns.push_back(f);
+        replacements.push_back(t);
+        automaton.add(f);
+    }
+    // makes the automaton once all the rules are added.
+    void build() {
+        automaton.build();
+    }
+    void replaceAll(std::string &input, const VMaper &) const override {
+        std::string res;
+        automaton.replace(input.data(), input.data() + input.size(), replacements, res);
+        input.swap(res);
+    }
+private:
+    std::vector<std::string> patterns, replacements;
+    AhoCorasick automaton;
 };
 class TransActRegex: public TransAction {
 public:
-    TransActRegex(char *f, char *t) {
+    // a pattern with variables is compiled once for each of the books,
+    // replaceAll() is only given those.
+    TransActRegex(char *f, char *t, const std::map<std::string, std::string> &books) {
         constructString(f, true);
         constructString(t, false);
         if (from.size() == 1 && from.front().flag == 0) {
@@ -102,116 +161,93 @@ public:
                 printf("Regex error1:%s\n", str.c_str());
                 exit(2);
             }
+        } else {
+            for (auto it = books.begin(); it != books.end(); ++it) {
+                const std::string str = genFormatText(from, dictVars(it));
+                if (book_re.count(str))
+                    continue;
+                std::unique_ptr<std::regex> &bre = book_re[str];
+                try {
+                    bre.reset(new std::regex(str, std::regex::optimize));
+                } catch (const std::regex_error &) {
+                    printf("Regex error2:%s\n", str.c_str());
+                    // keep the book running without this rule.
+                }
+            }
         }
     }
-    void replaceAll(std::string &input, const VMaper &params) override {
-        std::string f = genFormatText(from, params);
+    void replaceAll(std::string &input, const VMaper &params) const override {
         std::string t = genFormatText(to, params);
-        if (re != nullptr)
+        if (re != nullptr) {
             input = std::regex_replace(input, *re, t);
-        else try {
-            input = std::regex_replace(input, std::regex(f), t);
-        } catch (const std::regex_error &) {
-            printf("Regex error2:%s\n", f.c_str());
-            // do not exit when running.
+            return;
         }
+        std::string f = genFormatText(from, params);
+        const auto it = book_re.find(f);
+        // the constructor compiled the pattern of each book there is.
+        if (it == book_re.end())
+            throw std::logic_error("regex rule not compiled for book " + params("DICT_NAME") + ": " + f);
+        if (it->second != nullptr)
+            input = std::regex_replace(input, *it->second, t);
     }
 private:
     std::unique_ptr<std::regex> re;
+    // the patterns with variables by their text for each book, nullptr
+    // for those that do not compile.
+    std::map<std::string, std::unique_ptr<std::regex>> book_re;
+};
+// The built-in XDXF converter, ":x native" in the format file. It does in
+// one pass what the :x rules of dist/format.conf do, but for the
+// /usr/share/stardict/dic= rule, which stays a rule after it.
+class TransActXdxf: public TransAction {
+public:
+    void replaceAll(std::string &input, const VMaper &params) const override {
+        std::string res;
+        xdxf_to_html(input.data(), input.data() + input.size(), params("DICT_PATH"), res);
+        input.swap(res);
+    }
 };
 
 class TransformatTemplate {
 public:
-    explicit TransformatTemplate(const char *fileName);
+    TransformatTemplate(const char *fileName, const std::map<std::string, std::string> &books);
     TransformatTemplate(TransformatTemplate&) = delete;
     TransformatTemplate(TransformatTemplate&&other):customRep(std::move(other.customRep)) {}
-    std::string generate(const CBook_it &dictname, const char *xstr, char sametypesequence, uint32_t &sec_size);
+    std::string generate(const CBook_it &dictname, const char *xstr, size_t len, char sametypesequence) const;
 private:
     std::map<char, CustomType> customRep;
 };
 //----------------------------------------
-class TemplateHolder {
-public:
-    TemplateHolder(char htype):holderType(htype){}
-    TemplateHolder(TemplateHolder&) = delete;
-    virtual ~TemplateHolder(){}
-    virtual std::string toString(const VMaper &) const {return "";}
-    const char holderType;
-};
-class MarkerHolder: public TemplateHolder {
-    // do mark on header and footer.
-public:
-    MarkerHolder(char f):TemplateHolder('M'), flag(f){}
-    MarkerHolder(MarkerHolder&) = delete;
-    const char flag;//'h' for header, 'b' for body, 'f' for footer.
-};
-class TextHolder: public TemplateHolder {
-    // actual text or variable
-public:
-    TextHolder(const char *s, char f, char fl): TemplateHolder('T'), flag(fl), vstr(s, f) {}
-    TextHolder(TextHolder&) = delete;
-    std::string toString(const VMaper &getter) const override {
-        if (flag == 'j' && vstr.flag) {
-            //json format.
-            return json_escape_string(vstr.toString(getter));
-        }
-        return vstr.toString(getter);
-    }
-    const char flag;//same as in MarkerHolder.
-private:
-    VarString vstr;
-};
-template<class ContainerObj, class ObjIt>
-class ForHolder: public TemplateHolder {
-    // word loops.
-public:
-    ForHolder(VMaper (*fg)(const ObjIt &,int,const VMaper &)):TemplateHolder('F'),obj(nullptr),funcgetter(fg) {}
-    ForHolder(ForHolder&) = delete;
-    ~ForHolder() {
-        for (const auto t: innerHolder) {
-            delete(t);
-        }
-    }
-    std::string toString(const VMaper &getter) const override {
-        std::string result;
-        if (innerHolder.size() <= 0 || obj == nullptr) {
-            return "";
-        }
-        int idx = 0;
-        for (ObjIt it = obj->begin(); it != obj->end(); ++it) {
-            ++idx;
-            const auto &xg = (*funcgetter)(it, idx, getter);
-            for (const auto &vs: innerHolder) {
-                result += vs->toString(xg);
-            }
-        }
-        return result;
-    }
-    void addHolder(TemplateHolder *th){
-        innerHolder.push_back(th);
-    }
-    ContainerObj *obj;
-private:
-    VMaper (*funcgetter)(const ObjIt &it,int,const VMaper &);
-    std::list<TemplateHolder*> innerHolder;
+// out.htm compiled into a flat list of instructions, with the text of
+// all the literals in one string.
+struct TemplateOp {
+    enum op_t : char {
+        opTEXT,// text[a, a + b)
+        opVAR,// variable a, JSON escaped when b is set
+        opMARKER,// {{m:a}}, 'h' for header, 'b' for body, 'f' for footer.
+        opFOR,// the loop body is up to op a, excluded. only opTEXT and opVAR in it.
+    };
+    enum var_t {
+        vNONE,// unknown, empty
+        vSTR,// {{str}} the word that just looked up
+        vINDEX,// {{idx}} the loop auto-increment index
+        vWORD,// {{word}} actual word
+        vBOOKNAME,// {{bookname}} dictionary name
+        vDEFINITION,// {{definition}} the definition in dictionary
+    };
+    op_t op;
+    uint32_t a, b;
 };
 class ResponseOut {
 public:
     explicit ResponseOut(const char *fileName);
     ResponseOut(const ResponseOut &) = delete;
-    ResponseOut(const ResponseOut &&o):buffer(std::move(o.buffer)), elements(std::move(o.elements)){}
+    ResponseOut(ResponseOut &&o):ops(std::move(o.ops)), text(std::move(o.text)){}
     ResponseOut &operator=(const ResponseOut &) = delete;
-    ~ResponseOut() {
-        for (const auto t: elements) {
-            delete(t);
-        }
-    }
-    inline const std::string &get_content() const {return buffer;}
-    inline void reset() {buffer.clear();}
-    void make_content(bool isWrap, TSearchResultList &res_list, const char *str);
+    std::string make_content(bool isWrap, const TSearchResultList &res_list, const char *str) const;
 protected:
-    std::string buffer;
-    std::list<TemplateHolder*> elements;
+    std::vector<TemplateOp> ops;
+    std::string text;
 };
 //----------------------------------------
 //this class is wrapper around Dicts class for easy use
@@ -219,20 +255,21 @@ protected:
 class Library : public Libs {
 public:
     Library(const Param_config &param, const std::map<std::string, std::string> &&bookname2path)
-        : Libs(param), bookname_to_path(bookname2path), transformatter(param.transformat), rout(param.output_temp)
+        : Libs(param), bookname_to_path(bookname2path), transformatter(param.transformat, bookname_to_path), rout(param.output_temp)
     {
     }
 
-    const std::string process_phrase(const char *loc_str, bool all_data);
-    const std::string get_neighbour(const char *str, int offset, uint32_t length);
-    std::string parse_data(const CBook_it &dictname, const char *data);
+    // Both may be called from several threads at once.
+    const std::string process_phrase(const char *loc_str, bool all_data) const;
+    const std::string get_neighbour(const char *str, int offset, uint32_t length) const;
+    std::string parse_data(const CBook_it &dictname, const WordData &data) const;
 private:
     const std::map<std::string, std::string> bookname_to_path;
-    TransformatTemplate transformatter;
-    ResponseOut rout;
+    const TransformatTemplate transformatter;
+    const ResponseOut rout;
 
-    void SimpleLookup(const std::string &str, TSearchResultList &res_list);
-    void LookupWithFuzzy(const std::string &str, TSearchResultList &res_list);
-    void LookupWithRule(const std::string &str, TSearchResultList &res_lsit);
-    void LookupData(const std::string &str, TSearchResultList &res_list);
+    void SimpleLookup(const std::string &str, TSearchResultList &res_list, QueryContext &ctx) const;
+    void LookupWithFuzzy(const std::string &str, TSearchResultList &res_list, QueryContext &ctx) const;
+    void LookupWithRule(const std::string &str, TSearchResultList &res_lsit, QueryContext &ctx) const;
+    void LookupData(const std::string &str, TSearchResultList &res_list, QueryContext &ctx) const;
 };
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Least recently used cache with a budget in bytes. It is split into
+// shards with a lock each, so threads looking up different keys rarely
+// wait for each other. Values are shared, a value stays valid for whoever
+// holds it after it has been evicted.
+template <class Key, class Value, class Hash = std::hash<Key>>
+class LruCache
+{
+public:
+    explicit LruCache(size_t budget, size_t nshards = 16)
+        : shard_budget(budget / nshards)
+        , nhit(0)
+        , nmiss(0)
+    {
+        for (size_t i = 0; i < nshards; ++i)
+            shards.emplace_back(new Shard);
+    }
+    LruCache(const LruCache &) = delete;
+    LruCache &operator=(const LruCache &) = delete;
+
+    std::shared_ptr<const Value> get(const Key &key)
+    {
+        Shard &shard = shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const auto it = shard.index.find(key);
+        if (it == shard.index.end()) {
+            ++nmiss;
+            return nullptr;
+        }
+        ++nhit;
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return it->second->value;
+    }
+
+    // Like get() for a scan over many keys: an entry found is not made
+    // the most recently used one, and hits and misses are not counted, so
+    // the scan leaves the cache as it found it.
+    std::shared_ptr<const Value> peek(const Key &key) const
+    {
+        const Shard &shard = shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const auto it = shard.index.find(key);
+        return it == shard.index.end() ? nullptr : it->second->value;
+    }
+
+    // `bytes` is what the entry is charged against the budget. Entries
+    // larger than a shard's share of the budget are not kept.
+    void put(const Key &key, std::shared_ptr<const Value> value, size_t bytes)
+    {
+        if (bytes > shard_budget)
+            return;
+        Shard &shard = shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            shard.bytes -= it->second->bytes;
+            shard.lru.erase(it->second);
+            shard.index.erase(it);
+        }
+        shard.lru.push_front(Entry{key, std::move(value), bytes});
+        shard.index[key] = shard.lru.begin();
+        shard.bytes += bytes;
+        while (shard.bytes > shard_budget) {
+            const Entry &last = shard.lru.back();
+            shard.bytes -= last.bytes;
+            shard.index.erase(last.key);
+            shard.lru.pop_back();
+        }
+    }
+
+    void clear()
+    {
+        for (auto &shard : shards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            shard->index.clear();
+            shard->lru.clear();
+            shard->bytes = 0;
+        }
+    }
+
+    size_t hits() const { return nhit; }
+    size_t misses() const { return nmiss; }
+    size_t bytes() const
+    {
+        size_t total = 0;
+        for (auto &shard : shards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            total += shard->bytes;
+        }
+        return total;
+    }
+    size_t size() const
+    {
+        size_t total = 0;
+        for (auto &shard : shards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            total += shard->index.size();
+        }
+        return total;
+    }
+
+private:
+    struct Entry {
+        Key key;
+        std::shared_ptr<const Value> value;
+        size_t bytes;
+    };
+    struct Shard {
+        mutable std::mutex mutex;
+        std::list<Entry> lru; // most recently used first
+        std::unordered_map<Key, typename std::list<Entry>::iterator, Hash> index;
+        size_t bytes = 0;
+    };
+
+    Shard &shard_of(const Key &key) const
+    {
+        const size_t h = Hash()(key);
+        return *shards[(h ^ (h >> 16)) % shards.size()];
+    }
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    const size_t shard_budget;
+    std::atomic<size_t> nhit, nmiss;
+};
@@ -23,6 +23,7 @@ public:
     MapFile &operator=(const MapFile &) = delete;
     bool open(const char *file_name, unsigned long file_size);
     char *begin() { return data; }
+    const char *begin() const { return data; }
 
 private:
     char *data = nullptr;
@@ -0,0 +1,127 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstdio>
+
+#include "metrics.hpp"
+
+// upper bounds of the buckets in seconds, the last one is +Inf.
+static const double bucket_bounds[LatencyHistogram::NBUCKETS - 1] = {
+    0.00001, 0.00005, 0.0001, 0.0005, 0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1,
+};
+
+static const char *const stage_names[msSTAGE_COUNT] = {
+    "analyze_query", "simple_lookup", "fuzzy_lookup", "rule_lookup",
+    "data_lookup", "word_data", "transform", "make_content",
+};
+
+// in query_t order.
+static const char *const query_names[] = {
+    "simple", "regexp", "fuzzy", "data",
+};
+
+static const char *const cache_names[mcCACHE_COUNT] = {
+    "word_data", "dict_chunk", "index_page",
+};
+
+LatencyHistogram::LatencyHistogram()
+    : count(0)
+    , sum_ns(0)
+{
+    for (auto &b : buckets)
+        b.store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::observe(uint64_t ns)
+{
+    const double sec = ns / 1e9;
+    int i = 0;
+    while (i < NBUCKETS - 1 && sec > bucket_bounds[i])
+        ++i;
+    buckets[i].fetch_add(1, std::memory_order_relaxed);
+    sum_ns.fetch_add(ns, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::render(std::string &out, const char *name, const char *label) const
+{
+    char line[256];
+    uint64_t cumulative = 0;
+    for (int i = 0; i < NBUCKETS; ++i) {
+        cumulative += buckets[i].load(std::memory_order_relaxed);
+        if (i < NBUCKETS - 1)
+            snprintf(line, sizeof(line), "%s_bucket{%s,le=\"%g\"} %llu\n", name, label, bucket_bounds[i],
+                     static_cast<unsigned long long>(cumulative));
+        else
+            snprintf(line, sizeof(line), "%s_bucket{%s,le=\"+Inf\"} %llu\n", name, label,
+                     static_cast<unsigned long long>(cumulative));
+        out += line;
+    }
+    snprintf(line, sizeof(line), "%s_sum{%s} %.9f\n%s_count{%s} %llu\n", name, label,
+             sum_ns.load(std::memory_order_relaxed) / 1e9, name, label,
+             static_cast<unsigned long long>(count.load(std::memory_order_relaxed)));
+    out += line;
+}
+
+Metrics &Metrics::instance()
+{
+    static Metrics metrics;
+    return metrics;
+}
+
+Metrics::Metrics()
+{
+    for (auto &q : queries)
+        q.store(0, std::memory_order_relaxed);
+    for (int i = 0; i < mcCACHE_COUNT; ++i) {
+        cache_hits[i].store(0, std::memory_order_relaxed);
+        cache_misses[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+std::string Metrics::render() const
+{
+    std::string out;
+    char line[256];
+
+    out += "# HELP sdwv_stage_seconds Time spent in each stage of a query, stages nest.\n"
+           "# TYPE sdwv_stage_seconds histogram\n";
+    for (int i = 0; i < msSTAGE_COUNT; ++i) {
+        snprintf(line, sizeof(line), "stage=\"%s\"", stage_names[i]);
+        stages[i].render(out, "sdwv_stage_seconds", line);
+    }
+
+    out += "# TYPE sdwv_queries_total counter\n";
+    for (int i = 0; i < NQUERY_TYPES; ++i) {
+        snprintf(line, sizeof(line), "sdwv_queries_total{type=\"%s\"} %llu\n", query_names[i],
+                 static_cast<unsigned long long>(queries[i].load(std::memory_order_relaxed)));
+        out += line;
+    }
+
+    uint64_t hits[mcCACHE_COUNT], misses[mcCACHE_COUNT];
+    for (int i = 0; i < mcCACHE_COUNT; ++i) {
+        hits[i] = cache_hits[i].load(std::memory_order_relaxed);
+        misses[i] = cache_misses[i].load(std::memory_order_relaxed);
+    }
+    out += "# TYPE sdwv_cache_hits_total counter\n";
+    for (int i = 0; i < mcCACHE_COUNT; ++i) {
+        snprintf(line, sizeof(line), "sdwv_cache_hits_total{cache=\"%s\"} %llu\n", cache_names[i],
+                 static_cast<unsigned long long>(hits[i]));
+        out += line;
+    }
+    out += "# TYPE sdwv_cache_misses_total counter\n";
+    for (int i = 0; i < mcCACHE_COUNT; ++i) {
+        snprintf(line, sizeof(line), "sdwv_cache_misses_total{cache=\"%s\"} %llu\n", cache_names[i],
+                 static_cast<unsigned long long>(misses[i]));
+        out += line;
+    }
+    out += "# TYPE sdwv_cache_hit_ratio gauge\n";
+    for (int i = 0; i < mcCACHE_COUNT; ++i) {
+        const uint64_t total = hits[i] + misses[i];
+        snprintf(line, sizeof(line), "sdwv_cache_hit_ratio{cache=\"%s\"} %g\n", cache_names[i],
+                 total ? double(hits[i]) / total : 0.0);
+        out += line;
+    }
+    return out;
+}
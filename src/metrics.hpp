@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Stages of Library::process_phrase. They nest: a lookup includes reading
+// and transforming the data of the words it found.
+enum metric_stage {
+    msANALYZE_QUERY,
+    msSIMPLE_LOOKUP,
+    msFUZZY_LOOKUP,
+    msRULE_LOOKUP,
+    msDATA_LOOKUP,
+    msWORD_DATA,
+    msTRANSFORM,
+    msMAKE_CONTENT,
+    msSTAGE_COUNT
+};
+
+// Per-query caches: word data of a dictionary, inflated .dict.dz chunks
+// and the parsed index page.
+enum metric_cache {
+    mcWORD_DATA,
+    mcDICT_CHUNK,
+    mcINDEX_PAGE,
+    mcCACHE_COUNT
+};
+
+// Latency histogram with fixed buckets. Updates are relaxed atomic adds, so
+// a scrape racing with a request may see its count before its bucket.
+class LatencyHistogram
+{
+public:
+    static const int NBUCKETS = 12;
+
+    LatencyHistogram();
+    LatencyHistogram(const LatencyHistogram &) = delete;
+    LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+
+    void observe(uint64_t ns);
+    void render(std::string &out, const char *name, const char *label) const;
+
+private:
+    std::atomic<uint64_t> buckets[NBUCKETS];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum_ns;
+};
+
+// Process wide counters of the lookup path, read by the /metrics route.
+class Metrics
+{
+public:
+    static Metrics &instance();
+
+    void observe(metric_stage stage, std::chrono::steady_clock::duration d)
+    {
+        stages[stage].observe(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+    }
+    void count_query(int type) // a query_t
+    {
+        if (type >= 0 && type < NQUERY_TYPES)
+            queries[type].fetch_add(1, std::memory_order_relaxed);
+    }
+    void count_cache(metric_cache cache, uint64_t hits, uint64_t misses)
+    {
+        cache_hits[cache].fetch_add(hits, std::memory_order_relaxed);
+        cache_misses[cache].fetch_add(misses, std::memory_order_relaxed);
+    }
+    // Prometheus text exposition format.
+    std::string render() const;
+
+private:
+    static const int NQUERY_TYPES = 4;
+
+    Metrics();
+
+    LatencyHistogram stages[msSTAGE_COUNT];
+    std::atomic<uint64_t> queries[NQUERY_TYPES];
+    std::atomic<uint64_t> cache_hits[mcCACHE_COUNT];
+    std::atomic<uint64_t> cache_misses[mcCACHE_COUNT];
+};
+
+// Adds the time spent in the enclosing scope to one stage.
+class StageTimer
+{
+public:
+    explicit StageTimer(metric_stage s)
+        : stage(s)
+        , start(std::chrono::steady_clock::now())
+    {
+    }
+    ~StageTimer() { Metrics::instance().observe(stage, std::chrono::steady_clock::now() - start); }
+    StageTimer(const StageTimer &) = delete;
+    StageTimer &operator=(const StageTimer &) = delete;
+
+private:
+    const metric_stage stage;
+    const std::chrono::steady_clock::time_point start;
+};
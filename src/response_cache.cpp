@@ -0,0 +1,54 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <zlib.h>
+
+#include "response_cache.hpp"
+
+static std::string gzip_compress(const std::string &in)
+{
+    z_stream strm;
+    strm.zalloc = Z_NULL;
+    strm.zfree = Z_NULL;
+    strm.opaque = Z_NULL;
+    // 31: deflate with a gzip header, what Content-Encoding: gzip expects.
+    if (deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return std::string();
+
+    std::string out(deflateBound(&strm, in.size()), '\0');
+    strm.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+    strm.avail_in = in.size();
+    strm.next_out = (Bytef *)&out[0];
+    strm.avail_out = out.size();
+    if (deflate(&strm, Z_FINISH) != Z_STREAM_END)
+        out.clear();
+    else
+        out.resize(strm.total_out);
+    deflateEnd(&strm);
+    return out;
+}
+
+const std::string &CachedPage::gzipped() const
+{
+    std::call_once(gzip_once, [this]() { gzip = gzip_compress(body); });
+    return gzip;
+}
+
+ResponseCache::ResponseCache(size_t budget)
+    : lru(budget)
+{
+}
+
+std::shared_ptr<const CachedPage> ResponseCache::fetch(const std::string &query, bool content_only,
+                                                        const std::function<std::string()> &render)
+{
+    const std::string key = (content_only ? 'c' : 'a') + query;
+    auto page = lru.get(key);
+    if (page)
+        return page;
+
+    page = std::make_shared<const CachedPage>(render());
+    lru.put(key, page, key.size() + page->body.size() + page->body.size() / 2); // room for the gzip form
+    return page;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "lrucache.hpp"
+
+// A rendered result page. The gzip form is made the first time a client
+// asks for it.
+class CachedPage {
+public:
+    explicit CachedPage(std::string &&b) : body(std::move(b)) {}
+    CachedPage(const CachedPage &) = delete;
+    CachedPage &operator=(const CachedPage &) = delete;
+
+    const std::string &gzipped() const;
+
+    const std::string body;
+private:
+    mutable std::once_flag gzip_once;
+    mutable std::string gzip;
+};
+
+// Pages of Library::process_phrase keyed by query and content-only flag.
+// The Library is loaded once, so a page stays right as long as the
+// process runs: changed templates or dictionary files take a restart,
+// which also starts with an empty cache.
+class ResponseCache {
+public:
+    explicit ResponseCache(size_t budget);
+    ResponseCache(const ResponseCache &) = delete;
+    ResponseCache &operator=(const ResponseCache &) = delete;
+
+    // returns the cached page, or the one made by render() on a miss.
+    std::shared_ptr<const CachedPage> fetch(const std::string &query, bool content_only,
+                                            const std::function<std::string()> &render);
+
+    size_t hits() const { return lru.hits(); }
+    size_t misses() const { return lru.misses(); }
+    size_t bytes() const { return lru.bytes(); }
+    size_t size() const { return lru.size(); }
+
+private:
+    LruCache<std::string, CachedPage> lru;
+};
@@ -31,11 +31,14 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 #include <getopt.h>
 #include <unistd.h>
 
 #include "libwrapper.hpp"
+#include "metrics.hpp"
+#include "response_cache.hpp"
 #include "utils.hpp"
 #include "httplib.h"
 
@@ -43,6 +46,7 @@ static const char gVersion[] = VERSION;
 
 static void list_dicts(const std::list<std::string> &dicts_dir_list);
 static std::unique_ptr<Library> prepare(Param_config &param);
+static bool accepts_gzip(const std::string &accept_encoding);
 
 int main(int argc, char *argv[]) try {
     Param_config param;
@@ -65,10 +69,18 @@ int main(int argc, char *argv[]) try {
                 {"transformat",   required_argument, 0,  't' },
                 {"port",          required_argument, 0,  'p' },
                 {"daemon",        no_argument,       0,  'd' },
+                {"threads",       required_argument, 0,  'T' },
+                {"event-loop",    no_argument,       0,  'E' },
+                {"cache-size",    required_argument, 0,  'C' },
+                {"load-report",   no_argument,       0,  'L' },
+                {"word-cache",    required_argument, 0,  'W' },
+                {"chunk-cache",   required_argument, 0,  'Z' },
+                {"fuzzy-threads", required_argument, 0,  'F' },
+                {"token-index",   no_argument,       0,  'I' },
                 {0, 0, 0, 0 }
             };
 
-            c = getopt_long(argc, argv, "hvlu:o:e2:xt:p:d",
+            c = getopt_long(argc, argv, "hvlu:o:e2:xt:p:dT:EC:LW:Z:F:I",
                      long_options, &option_index);
             if (c == -1)
                 break;
@@ -129,6 +141,50 @@ int main(int argc, char *argv[]) try {
             case 'd':
                 param.daemonize = true;
                 break;
+            case 'T':
+                arg = 1;
+                if (optarg)
+                    param.threads = (int)strtol(optarg, NULL, 10);
+                else
+                    printf("Omitting arg to '-%c'.\n", c);
+                break;
+            case 'E':
+                param.event_loop = true;
+                break;
+            case 'C':
+                arg = 1;
+                if (optarg)
+                    param.cache_size = (int)strtol(optarg, NULL, 10);
+                else
+                    printf("Omitting arg to '-%c'.\n", c);
+                break;
+            case 'L':
+                param.load_report = true;
+                break;
+            case 'W':
+                arg = 1;
+                if (optarg)
+                    param.word_cache_size = (int)strtol(optarg, NULL, 10);
+                else
+                    printf("Omitting arg to '-%c'.\n", c);
+                break;
+            case 'Z':
+                arg = 1;
+                if (optarg)
+                    param.chunk_cache_size = (int)strtol(optarg, NULL, 10);
+                else
+                    printf("Omitting arg to '-%c'.\n", c);
+                break;
+            case 'F':
+                arg = 1;
+                if (optarg)
+                    param.fuzzy_threads = (int)strtol(optarg, NULL, 10);
+                else
+                    printf("Omitting arg to '-%c'.\n", c);
+                break;
+            case 'I':
+                param.token_index = true;
+                break;
             case '?':
                 break;
 
@@ -167,6 +223,14 @@ int main(int argc, char *argv[]) try {
                 "  -t, --transformat      the transformat file name. Default: format.conf\n"
                 "  -p, --port             the port to listen\n"
                 "  -d, --daemon           run in daemon mode.\n"
+                "  -T, --threads          number of HTTP worker threads. Default: one per CPU core\n"
+                "  -E, --event-loop       serve keep-alive connections from one epoll thread (Linux)\n"
+                "  -C, --cache-size       MiB of rendered pages to keep, 0 to disable. Default: 64\n"
+                "  -L, --load-report      print how long each dictionary took to load\n"
+                "  -W, --word-cache       MiB of decoded dictionary entries to keep, 0 to disable. Default: 16\n"
+                "  -Z, --chunk-cache      MiB of decompressed .dict.dz chunks to keep, 0 to disable. Default: 32\n"
+                "  -F, --fuzzy-threads    threads the fuzzy lookups share. Default: one per CPU core\n"
+                "  -I, --token-index      keep an inverted index of the definition words for |data searches\n"
                 "\n");
         return EXIT_SUCCESS;
     }
@@ -189,7 +253,19 @@ int main(int argc, char *argv[]) try {
     }
 
     if (param.listen_port > 0) {
-        httplib::Server serv;
+        httplib::Server serv(param.event_loop ? httplib::HttpVersion::v1_1 : httplib::HttpVersion::v1_0);
+        int threads = param.threads;
+        if (threads <= 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        serv.set_thread_count(threads);
+        if (!serv.set_event_loop(param.event_loop)) {
+            puts("event loop is not supported on this system, ignored.");
+        }
+        std::unique_ptr<ResponseCache> cache;
+        if (param.cache_size > 0) {
+            cache.reset(new ResponseCache(size_t(param.cache_size) << 20));
+        }
         serv.set_base_dir(param.opt_data_dir);
         serv.get("/", [&](const httplib::Request &req, httplib::Response &res) {
             bool all_data = true;
@@ -201,8 +277,55 @@ int main(int argc, char *argv[]) try {
                 serv.stop();
             }
 #endif
-            const std::string &result = lib->process_phrase(req.get_param_value("w").c_str(), all_data);
-            res.set_content(result, "text/html");
+            const std::string &word = req.get_param_value("w");
+            if (!cache) {
+                const std::string &result = lib->process_phrase(word.c_str(), all_data);
+                res.set_content(result, "text/html");
+                return;
+            }
+            const auto page = cache->fetch(word, !all_data, [&]() {
+                return lib->process_phrase(word.c_str(), all_data);
+            });
+            res.set_header("Vary", "Accept-Encoding");
+            if (accepts_gzip(req.get_header_value("Accept-Encoding")) && !page->gzipped().empty()) {
+                res.set_header("Content-Encoding", "gzip");
+                res.set_content(page->gzipped(), "text/html");
+            } else {
+                res.set_content(page->body, "text/html");
+            }
+        });
+        serv.get("/metrics", [&](const httplib::Request &, httplib::Response &res) {
+            std::string out;
+            char line[128];
+            if (cache) {
+                const struct {
+                    const char *name, *type;
+                    size_t value;
+                } metrics[] = {
+                    {"sdwv_response_cache_hits_total", "counter", cache->hits()},
+                    {"sdwv_response_cache_misses_total", "counter", cache->misses()},
+                    {"sdwv_response_cache_entries", "gauge", cache->size()},
+                    {"sdwv_response_cache_bytes", "gauge", cache->bytes()},
+                };
+                for (const auto &m : metrics) {
+                    snprintf(line, sizeof(line), "# TYPE %s %s\n%s %zu\n", m.name, m.type, m.name, m.value);
+                    out += line;
+                }
+            }
+            if (const WordDataCache *words = lib->word_cache()) {
+                snprintf(line, sizeof(line), "# TYPE sdwv_word_cache_entries gauge\nsdwv_word_cache_entries %zu\n", words->size());
+                out += line;
+                snprintf(line, sizeof(line), "# TYPE sdwv_word_cache_bytes gauge\nsdwv_word_cache_bytes %zu\n", words->bytes());
+                out += line;
+            }
+            if (const DictChunkCache *chunks = lib->chunk_cache()) {
+                snprintf(line, sizeof(line), "# TYPE sdwv_chunk_cache_entries gauge\nsdwv_chunk_cache_entries %zu\n", chunks->size());
+                out += line;
+                snprintf(line, sizeof(line), "# TYPE sdwv_chunk_cache_bytes gauge\nsdwv_chunk_cache_bytes %zu\n", chunks->bytes());
+                out += line;
+            }
+            out += Metrics::instance().render();
+            res.set_content(out, "text/plain; version=0.0.4");
         });
         serv.get("/neigh", [&](const httplib::Request &req, httplib::Response &res) {
             int offset;
@@ -335,6 +458,44 @@ static std::unique_ptr<Library> prepare(Param_config &param)
     lib->load(dicts_dir_list, order_list, disable_list);
     return lib;
 }
+// whether an Accept-Encoding header lists the gzip coding and does not
+// refuse it with q=0.
+static bool accepts_gzip(const std::string &accept_encoding)
+{
+    static const char blank[] = " \t";
+    for (std::string::size_type b = 0; b < accept_encoding.size();) {
+        std::string::size_type e = accept_encoding.find(',', b);
+        if (e == std::string::npos)
+            e = accept_encoding.size();
+        const std::string item = accept_encoding.substr(b, e - b);
+        b = e + 1;
+
+        std::string::size_type semi = item.find(';');
+        std::string coding = item.substr(0, semi);
+        coding.erase(0, coding.find_first_not_of(blank));
+        coding.erase(coding.find_last_not_of(blank) + 1);
+        if (strcasecmp(coding.c_str(), "gzip") != 0)
+            continue;
+        bool refused = false;
+        while (semi != std::string::npos) {
+            const std::string::size_type next = item.find(';', semi + 1);
+            std::string param = item.substr(semi + 1, next == std::string::npos ? next : next - semi - 1);
+            semi = next;
+            param.erase(std::remove_if(param.begin(), param.end(), [](char c) { return c == ' ' || c == '\t'; }),
+                        param.end());
+            if (param.size() < 2 || (param[0] != 'q' && param[0] != 'Q') || param[1] != '=')
+                continue;
+            // qvalue = ( "0" [ "." 0*3DIGIT ] ) / ( "1" [ "." 0*3("0") ] )
+            const std::string q = param.substr(2);
+            refused = !q.empty() && q[0] == '0' && (q.size() == 1 || (q[1] == '.' && q.size() <= 5 &&
+                      q.find_first_not_of('0', 2) == std::string::npos));
+        }
+        if (!refused)
+            return true;
+    }
+    return false;
+}
+
 static void list_dicts(const std::list<std::string> &dicts_dir_list)
 {
     printf("Dictionary's name   Word count\n");
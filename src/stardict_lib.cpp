@@ -4,9 +4,13 @@
 
 #include <algorithm>
 #include <cctype>
+#include <cerrno>
+#include <chrono>
 #include <cstring>
 #include <stdexcept>
+#include <thread>
 
+#include <fcntl.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/stat.h>
@@ -15,6 +19,7 @@
 
 #include "distance.hpp"
 #include "mapfile.hpp"
+#include "metrics.hpp"
 #include "utils.hpp"
 
 #include "stardict_lib.hpp"
@@ -59,13 +64,9 @@ static bool bIsPureEnglish(const char *str)
 
 static const std::string &g_get_user_cache_dir()
 {
-    static std::string user_cache;
-    if (user_cache.length() <= 0) {
-        if (getenv("HOME"))
-            user_cache = std::string(getenv("HOME")) + G_DIR_SEPARATOR ".cache";
-        else
-            user_cache = "/tmp/sdwv_cache";
-    }
+    // dictionaries are loaded in parallel, let the first caller set it up.
+    static const std::string user_cache(getenv("HOME") ? std::string(getenv("HOME")) + G_DIR_SEPARATOR ".cache"
+                                                       : std::string("/tmp/sdwv_cache"));
     return user_cache;
 }
 static inline int stardict_strcmp(const char *s1, const char *s2)
@@ -130,316 +131,444 @@ inline static void utf8_camelcase(char *p)
     }
 }
 #endif
-}
 
-char *DictBase::GetWordData(uint32_t idxitem_offset, uint32_t idxitem_size)
+// Walks an index whose lower-cased keys are sorted as a trie: keys sharing
+// a prefix with the one before reuse its rows of the edit distance matrix,
+// and a prefix that is already too far from the query is skipped together
+// with every key starting with it. A key is compared by the head as long
+// as the query, the same distance as EditDistance::CalEditDistance().
+class FuzzyTrieWalker
 {
-    for (int i = 0; i < WORDDATA_CACHE_NUM; i++)
-        if (cache[i].data && cache[i].offset == idxitem_offset)
-            return cache[i].data;
-
-    if (dictfile)
-        fseek(dictfile, idxitem_offset, SEEK_SET);
+public:
+    explicit FuzzyTrieWalker(const char *query)
+        : q(query)
+        , qlen(strlen(query))
+        , rows((qlen + 1) * (qlen + 1))
+        , mins(qlen + 1, 0)
+        , path(qlen, '\0')
+    {
+        for (int j = 0; j <= qlen; ++j)
+            rows[j] = j;
+    }
 
-    char *data;
-    if (!sametypesequence.empty()) {
-        char *origin_data((char *)malloc(idxitem_size));
-
-        if (dictfile) {
-            const size_t nitems = fread((origin_data), idxitem_size, 1, dictfile);
-            THROW_IF_ERROR(nitems == 1);
-        } else
-            dictdzfile->read((origin_data), idxitem_offset, idxitem_size);
-
-        uint32_t data_size;
-        int sametypesequence_len = sametypesequence.length();
-        //there have sametypesequence_len char being omitted.
-        data_size = idxitem_size + sizeof(uint32_t) + sametypesequence_len;
-        //if the last item's size is determined by the end up '\0',then +=sizeof(char);
-        //if the last item's size is determined by the head uint32_t type data,then +=sizeof(uint32_t);
-        switch (sametypesequence[sametypesequence_len - 1]) {
-        case 'm':
-        case 't':
-        case 'y':
-        case 'l':
-        case 'g':
-        case 'x':
-        case 'k':
-            data_size += sizeof(char);
-            break;
-        case 'W':
-        case 'P':
-            data_size += sizeof(uint32_t);
-            break;
-        default:
-            if (isupper(sametypesequence[sametypesequence_len - 1]))
-                data_size += sizeof(uint32_t);
-            else
-                data_size += sizeof(char);
-            break;
-        }
-        data = (char *)malloc(data_size);
-        char *p1, *p2;
-        p1 = data + sizeof(uint32_t);
-        p2 = origin_data;
-        uint32_t sec_size;
-        //copy the head items.
-        for (int i = 0; i < sametypesequence_len - 1; i++) {
-            *p1 = sametypesequence[i];
-            p1 += sizeof(char);
-            switch (sametypesequence[i]) {
-            case 'm':
-            case 't':
-            case 'y':
-            case 'l':
-            case 'g':
-            case 'x':
-            case 'k':
-                sec_size = strlen(p2) + 1;
-                memcpy(p1, p2, sec_size);
-                p1 += sec_size;
-                p2 += sec_size;
-                break;
-            case 'W':
-            case 'P':
-                sec_size = get_uint32(p2);
-                sec_size += sizeof(uint32_t);
-                memcpy(p1, p2, sec_size);
-                p1 += sec_size;
-                p2 += sec_size;
-                break;
-            default:
-                if (isupper(sametypesequence[i])) {
-                    sec_size = get_uint32(p2);
-                    sec_size += sizeof(uint32_t);
-                } else {
-                    sec_size = strlen(p2) + 1;
+    // calls found(key, distance) in index order for the keys of [lo, hi)
+    // that may be within limit, the limit can go down during the walk.
+    void walk(const Dict &dict, IndexCursor &cur, int32_t lo, int32_t hi, const int &limit,
+              const std::function<void(const char *, int)> &found)
+    {
+        int depth = 0; // rows[0..depth] are those of path[0..depth)
+        for (int32_t index = lo; index < hi;) {
+            const char *key = dict.get_key(index, cur);
+            int k = 0;
+            while (k < depth && key[k] && char(tolower(key[k])) == path[k])
+                ++k;
+            depth = k;
+            bool skipped = false;
+            for (; depth < qlen && key[depth]; ++depth) {
+                path[depth] = tolower(key[depth]);
+                fill_row(depth + 1);
+                // a row, or the one before plus a transposition, bounds all rows below.
+                if (mins[depth + 1] >= limit && mins[depth] + 1 >= limit) {
+                    ++depth;
+                    index = skip_prefix(dict, cur, index, hi, depth);
+                    skipped = true;
+                    break;
                 }
-                memcpy(p1, p2, sec_size);
-                p1 += sec_size;
-                p2 += sec_size;
-                break;
             }
+            if (skipped)
+                continue;
+            const int keylen = depth < qlen ? depth : depth + strlen(key + depth);
+            if (keylen - qlen < limit && qlen - keylen < limit)
+                found(key, rows[depth * (qlen + 1) + qlen]);
+            ++index;
         }
-        //calculate the last item 's size.
-        sec_size = idxitem_size - (p2 - (origin_data));
-        *p1 = sametypesequence[sametypesequence_len - 1];
-        p1 += sizeof(char);
-        switch (sametypesequence[sametypesequence_len - 1]) {
-        case 'm':
-        case 't':
-        case 'y':
-        case 'l':
-        case 'g':
-        case 'x':
-        case 'k':
-            memcpy(p1, p2, sec_size);
-            p1 += sec_size;
-            *p1 = '\0'; //add the end up '\0';
-            break;
-        case 'W':
-        case 'P':
-            set_uint32(p1, sec_size);
-            p1 += sizeof(uint32_t);
-            memcpy(p1, p2, sec_size);
-            break;
-        default:
-            if (isupper(sametypesequence[sametypesequence_len - 1])) {
-                set_uint32(p1, sec_size);
-                p1 += sizeof(uint32_t);
-                memcpy(p1, p2, sec_size);
-            } else {
-                memcpy(p1, p2, sec_size);
-                p1 += sec_size;
-                *p1 = '\0';
+    }
+
+private:
+    void fill_row(int i)
+    {
+        int *row = &rows[i * (qlen + 1)];
+        const int *up = row - (qlen + 1);
+        const char c = path[i - 1];
+        row[0] = i;
+        int min = i;
+        for (int j = 1; j <= qlen; ++j) {
+            int d = minimum(up[j] + 1, row[j - 1] + 1, up[j - 1] + (c == q[j - 1] ? 0 : 1));
+            if (i >= 2 && j >= 2 && c == q[j - 2] && path[i - 2] == q[j - 1]) {
+                const int t = up[j - (qlen + 1) - 2] + 1;
+                if (t < d)
+                    d = t;
             }
-            break;
+            row[j] = d;
+            if (d < min)
+                min = d;
         }
-        set_uint32(data, data_size);
-        free(origin_data);
-    } else {
-        data = (char *)malloc(idxitem_size + sizeof(uint32_t));
-        if (dictfile) {
-            const size_t nitems = fread(data + sizeof(uint32_t), idxitem_size, 1, dictfile);
-            THROW_IF_ERROR(nitems == 1);
-        } else
-            dictdzfile->read(data + sizeof(uint32_t), idxitem_offset, idxitem_size);
-        set_uint32(data, idxitem_size + sizeof(uint32_t));
-    }
-    free(cache[cache_cur].data);
-
-    cache[cache_cur].data = data;
-    cache[cache_cur].offset = idxitem_offset;
-    cache_cur++;
-    if (cache_cur == WORDDATA_CACHE_NUM)
-        cache_cur = 0;
-    return data;
-}
+        mins[i] = min;
+    }
+
+    bool has_prefix(const char *key, int len) const
+    {
+        for (int k = 0; k < len; ++k)
+            if (!key[k] || char(tolower(key[k])) != path[k])
+                return false;
+        return true;
+    }
 
-bool DictBase::SearchData(std::vector<std::string> &SearchWords, uint32_t idxitem_offset, uint32_t idxitem_size, char *origin_data)
+    // first index after `index` whose key does not start with path[0..len), n at most.
+    int32_t skip_prefix(const Dict &dict, IndexCursor &cur, int32_t index, int32_t n, int len) const
+    {
+        int32_t lo = index, hi = index + 1, step = 1;
+        while (hi < n && has_prefix(dict.get_key(hi, cur), len)) {
+            lo = hi;
+            step *= 2;
+            hi = index + step;
+        }
+        if (hi > n)
+            hi = n;
+        // key lo has the prefix, key hi does not or is the end.
+        while (hi - lo > 1) {
+            const int32_t mid = lo + (hi - lo) / 2;
+            if (has_prefix(dict.get_key(mid, cur), len))
+                lo = mid;
+            else
+                hi = mid;
+        }
+        return hi;
+    }
+
+    const char *q;
+    const int qlen;
+    std::vector<int> rows; // (qlen + 1) rows of (qlen + 1)
+    std::vector<int> mins;
+    std::string path;
+};
+
+// a word near enough to be taken by a FuzzyList, in the order it was met.
+struct FuzzyCandidate {
+    std::string word;
+    int distance;
+};
+
+// The size nearest words met so far. A word nearer than the farthest of
+// the list takes its place, unless it is in the list already, so which
+// words are kept depends on the order they come in.
+class FuzzyList
 {
-    int nWord = SearchWords.size();
-    std::vector<bool> WordFind(nWord, false);
-    int nfound = 0;
-
-    if (dictfile)
-        fseek(dictfile, idxitem_offset, SEEK_SET);
-    if (dictfile) {
-        const size_t nitems = fread(origin_data, idxitem_size, 1, dictfile);
-        THROW_IF_ERROR(nitems == 1);
-    } else
-        dictdzfile->read(origin_data, idxitem_offset, idxitem_size);
-    char *p = origin_data;
-    uint32_t sec_size;
-    int j;
-    if (!sametypesequence.empty()) {
-        int sametypesequence_len = sametypesequence.length();
-        for (int i = 0; i < sametypesequence_len - 1; i++) {
-            switch (sametypesequence[i]) {
-            case 'm':
-            case 't':
-            case 'y':
-            case 'l':
-            case 'g':
-            case 'x':
-            case 'k':
-                for (j = 0; j < nWord; j++)
-                    if (!WordFind[j] && strstr(p, SearchWords[j].c_str())) {
-                        WordFind[j] = true;
-                        ++nfound;
-                    }
+public:
+    FuzzyList(int size, int max_distance, int query_len, std::vector<FuzzyCandidate> *taken = nullptr)
+        : list(size, Fuzzystruct{nullptr, max_distance})
+        , iMaxDistance(max_distance)
+        , ucs4_str2_len(query_len)
+        , log(taken)
+    {
+    }
+    ~FuzzyList()
+    {
+        for (auto &f : list)
+            free(f.pMatchWord);
+    }
+    FuzzyList(const FuzzyList &) = delete;
+    FuzzyList &operator=(const FuzzyList &) = delete;
 
-                if (nfound == nWord)
-                    return true;
-                sec_size = strlen(p) + 1;
-                p += sec_size;
-                break;
-            default:
-                if (isupper(sametypesequence[i])) {
-                    sec_size = get_uint32(p);
-                    sec_size += sizeof(uint32_t);
-                } else {
-                    sec_size = strlen(p) + 1;
+    // a word farther than this is never taken.
+    const int &max_distance() const { return iMaxDistance; }
+    bool found() const { return Found; }
+    // whether a word of len bytes can be near enough, the others are not looked at.
+    bool near_length(int len) const { return len - ucs4_str2_len < iMaxDistance && ucs4_str2_len - len < iMaxDistance; }
+
+    void consider(const char *sCheck, int iDistance)
+    {
+        if (iDistance < iMaxDistance && iDistance < ucs4_str2_len) {
+            // when ucs4_str2_len=1,2 we need less fuzzy.
+            Found = true;
+            if (log)
+                log->push_back({sCheck, iDistance});
+            bool bAlreadyInList = false;
+            int iMaxDistanceAt = 0;
+            for (size_t j = 0; j < list.size(); j++) {
+                if (list[j].pMatchWord && strcmp(list[j].pMatchWord, sCheck) == 0) { //already in list
+                    bAlreadyInList = true;
+                    break;
                 }
-                p += sec_size;
-            }
-        }
-        switch (sametypesequence[sametypesequence_len - 1]) {
-        case 'm':
-        case 't':
-        case 'y':
-        case 'l':
-        case 'g':
-        case 'x':
-        case 'k':
-            sec_size = idxitem_size - (p - origin_data);
-            for (j = 0; j < nWord; j++) {
-                char *t = strstr(p, SearchWords[j].c_str());
-                if (!WordFind[j] && t && uint32_t(t - p) < sec_size) {
-                    WordFind[j] = true;
-                    ++nfound;
+                //find the position,it will certainly be found (include the first time) as iMaxDistance is set by last time.
+                if (list[j].iMatchWordDistance == iMaxDistance) {
+                    iMaxDistanceAt = j;
                 }
             }
+            if (!bAlreadyInList) {
+                if (list[iMaxDistanceAt].pMatchWord)
+                    free(list[iMaxDistanceAt].pMatchWord);
+                list[iMaxDistanceAt].pMatchWord = strdup(sCheck);
+                list[iMaxDistanceAt].iMatchWordDistance = iDistance;
+                // calc new iMaxDistance
+                iMaxDistance = iDistance;
+                for (size_t j = 0; j < list.size(); j++) {
+                    if (list[j].iMatchWordDistance > iMaxDistance)
+                        iMaxDistance = list[j].iMatchWordDistance;
+                } // calc new iMaxDistance
+            } // add to list
+        } // find one
+    }
 
-            if (nfound == nWord)
-                return true;
-            break;
+    // sorts the words by distance and hands them over to reslist.
+    void release(char *reslist[])
+    {
+        if (Found) // sort with distance
+            std::sort(list.begin(), list.end(), [](const Fuzzystruct &lh, const Fuzzystruct &rh) -> bool {
+                if (lh.iMatchWordDistance != rh.iMatchWordDistance)
+                    return lh.iMatchWordDistance < rh.iMatchWordDistance;
+
+                if (lh.pMatchWord && rh.pMatchWord)
+                    return stardict_strcmp(lh.pMatchWord, rh.pMatchWord) < 0;
+
+                return false;
+            });
+
+        for (size_t i = 0; i < list.size(); ++i) {
+            reslist[i] = list[i].pMatchWord;
+            list[i].pMatchWord = nullptr;
         }
-    } else {
-        while (uint32_t(p - origin_data) < idxitem_size) {
-            switch (*p) {
-            case 'm':
-            case 't':
-            case 'y':
-            case 'l':
-            case 'g':
-            case 'x':
-            case 'k':
-                for (j = 0; j < nWord; j++)
-                    if (!WordFind[j] && strstr(p, SearchWords[j].c_str())) {
-                        WordFind[j] = true;
-                        ++nfound;
-                    }
+    }
 
-                if (nfound == nWord)
-                    return true;
-                sec_size = strlen(p) + 1;
-                p += sec_size;
-                break;
-            default:
-                if (isupper(*p)) {
-                    sec_size = get_uint32(p);
-                    sec_size += sizeof(uint32_t);
-                } else {
-                    sec_size = strlen(p) + 1;
-                }
+private:
+    std::vector<Fuzzystruct> list;
+    int iMaxDistance;
+    const int ucs4_str2_len;
+    bool Found = false;
+    std::vector<FuzzyCandidate> *const log; // words taken, for a later replay
+};
+}
+
+const char *DictBase::map_data(uint32_t idxitem_offset, uint32_t idxitem_size) const
+{
+    THROW_IF_ERROR(uint64_t(idxitem_offset) + idxitem_size <= dictsize);
+    return dictdata + idxitem_offset;
+}
+
+void DictBase::read_data(char *buffer, uint32_t idxitem_offset, uint32_t idxitem_size, QueryContext &ctx) const
+{
+    if (dictdata)
+        memcpy(buffer, map_data(idxitem_offset, idxitem_size), idxitem_size);
+    else
+        dictdzfile->read(ctx.dzctx, buffer, idxitem_offset, idxitem_size);
+}
+
+// the size of a field of type t at p, its ending '\0' or leading size
+// included, in an entry ending at end.
+static size_t field_size(char t, const char *p, const char *end)
+{
+    const size_t left = end - p;
+    if (isupper(t)) {
+        if (left < sizeof(uint32_t))
+            return left;
+        return std::min<size_t>(get_uint32(p) + sizeof(uint32_t), left);
+    }
+    const size_t len = strnlen(p, left);
+    return len < left ? len + 1 : len;
+}
+
+// the fields SearchData looks in.
+static bool searchable_field(char t)
+{
+    switch (t) {
+    case 'm':
+    case 't':
+    case 'y':
+    case 'l':
+    case 'g':
+    case 'x':
+    case 'k':
+        return true;
+    }
+    return false;
+}
+
+QueryContext::~QueryContext()
+{
+    unsigned long page_hits = 0, page_misses = 0;
+    for (const auto &cur : cursors) {
+        page_hits += cur.page_hits;
+        page_misses += cur.page_misses;
+    }
+    Metrics &metrics = Metrics::instance();
+    metrics.count_cache(mcWORD_DATA, cache_hits, cache_misses);
+    metrics.count_cache(mcDICT_CHUNK, dzctx.hits, dzctx.misses);
+    metrics.count_cache(mcINDEX_PAGE, page_hits, page_misses);
+}
+
+WordData DictBase::GetWordData(uint32_t idxitem_offset, uint32_t idxitem_size, QueryContext &ctx) const
+{
+    StageTimer timer(msWORD_DATA);
+    WordData word;
+    if (dictdata && sametypesequence.empty()) {
+        // the fields are as they are in the file.
+        word.fields = map_data(idxitem_offset, idxitem_size);
+        word.size = idxitem_size;
+        return word;
+    }
+
+    const WordDataKey key{this, idxitem_offset};
+    if (ctx.word_cache)
+        word.data = ctx.word_cache->get(key);
+    if (word.data) {
+        ++ctx.cache_hits;
+    } else {
+        ++ctx.cache_misses;
+        std::shared_ptr<std::string> value = std::make_shared<std::string>();
+        if (sametypesequence.empty()) {
+            value->resize(idxitem_size);
+            read_data(&(*value)[0], idxitem_offset, idxitem_size, ctx);
+        } else {
+            std::string buffer;
+            const char *origin_data;
+            if (dictdata) {
+                origin_data = map_data(idxitem_offset, idxitem_size);
+            } else {
+                buffer.resize(idxitem_size);
+                read_data(&buffer[0], idxitem_offset, idxitem_size, ctx);
+                origin_data = buffer.data();
+            }
+            // put the type chars sametypesequence leaves out back, and the
+            // end of the last field.
+            const char *p = origin_data, *end = origin_data + idxitem_size;
+            const int sametypesequence_len = sametypesequence.length();
+            value->reserve(idxitem_size + sametypesequence_len + sizeof(uint32_t));
+            for (int i = 0; i < sametypesequence_len - 1; i++) {
+                const size_t sec_size = field_size(sametypesequence[i], p, end);
+                *value += sametypesequence[i];
+                value->append(p, sec_size);
                 p += sec_size;
             }
+            const char last = sametypesequence[sametypesequence_len - 1];
+            const uint32_t sec_size = end - p;
+            *value += last;
+            if (isupper(last)) {
+                char size[sizeof(uint32_t)];
+                set_uint32(size, sec_size);
+                value->append(size, sizeof(size));
+                value->append(p, sec_size);
+            } else {
+                value->append(p, sec_size);
+                *value += '\0';
+            }
+        }
+        if (ctx.word_cache) {
+            // the string, the LRU list and map nodes.
+            const size_t overhead = sizeof(std::string) + sizeof(key) + 64;
+            ctx.word_cache->put(key, value, value->capacity() + overhead);
         }
+        word.data = std::move(value);
+    }
+    word.fields = word.data->data();
+    word.size = word.data->size();
+    return word;
+}
+
+// calls f(text, len) for each field of the entry [p, end) SearchData looks
+// in, the text ending at its '\0' or the end of the entry, until f returns
+// true. Whether f did.
+template <typename F>
+static bool for_each_search_text(const std::string &sametypesequence, const char *p, const char *end, F f)
+{
+    // a searchable field is text, its length is only found once.
+    const auto &field = [&](char t) {
+        if (!searchable_field(t)) {
+            p += field_size(t, p, end);
+            return false;
+        }
+        const size_t len = strnlen(p, end - p);
+        if (f(p, len))
+            return true;
+        p += len < size_t(end - p) ? len + 1 : len;
+        return false;
+    };
+    if (!sametypesequence.empty()) {
+        const int sametypesequence_len = sametypesequence.length();
+        for (int i = 0; i < sametypesequence_len && p < end; i++)
+            if (field(sametypesequence[i]))
+                return true;
+    } else {
+        while (p < end)
+            if (field(*p++))
+                return true;
     }
     return false;
 }
 
+bool DictBase::SearchData(TermMatcher &SearchWords, uint32_t idxitem_offset, uint32_t idxitem_size, char *origin_data, QueryContext &ctx) const
+{
+    const char *data;
+    if (dictdata) {
+        data = map_data(idxitem_offset, idxitem_size);
+    } else {
+        read_data(origin_data, idxitem_offset, idxitem_size, ctx);
+        data = origin_data;
+    }
+    return holds_all(SearchWords, data, idxitem_size);
+}
+
+bool DictBase::holds_all(TermMatcher &SearchWords, const char *data, uint32_t size) const
+{
+    SearchWords.reset();
+    return for_each_search_text(sametypesequence, data, data + size, [&SearchWords](const char *p, size_t len) {
+        return SearchWords.find(p, len);
+    });
+}
+
+// where the cache of url with suffix ext can be, next to url or in the user cache directory.
+static std::list<std::string> cache_variants(const std::string &url, const char *ext)
+{
+    std::list<std::string> res = { url + ext };
+    // another dictionary being loaded may have just made the directory.
+    if (access(g_get_user_cache_dir().c_str(), R_OK|W_OK|X_OK) && mkdir(g_get_user_cache_dir().c_str(), 0700) == -1 && errno != EEXIST)
+        return res;
+
+    const std::string cache_dir(g_get_user_cache_dir() + G_DIR_SEPARATOR + "sdwv");
+
+    if (access(cache_dir.c_str(), R_OK|W_OK|X_OK)) {
+        if (mkdir(cache_dir.c_str(), 0700) == -1 && errno != EEXIST)
+            return res;
+    } else if (access(cache_dir.c_str(), R_OK|W_OK|X_OK))
+        return res;
+
+    char *u = strdup(url.c_str());
+    const char *base = basename(u);
+    res.push_back(cache_dir + G_DIR_SEPARATOR + base + ext);
+    free(u);
+    return res;
+}
+
 namespace
 {
 class OffsetIndex : public IIndexFile
 {
 public:
-    OffsetIndex()
-        : idxfile(nullptr)
-    {
-    }
-    ~OffsetIndex()
+    OffsetIndex() {}
+    bool load(const std::string &url, uint32_t wc, uint32_t fsize, std::string *log) override;
+    const char *get_key(int32_t idx, IndexCursor &cur) const override;
+    void get_data(int32_t idx, IndexCursor &cur) const override { get_key(idx, cur); }
+    const char *get_key_and_data(int32_t idx, IndexCursor &cur) const override
     {
-        if (idxfile)
-            fclose(idxfile);
+        return get_key(idx, cur);
     }
-    bool load(const std::string &url, uint32_t wc, uint32_t fsize, bool verbose) override;
-    const char *get_key(int32_t idx) override;
-    void get_data(int32_t idx) override { get_key(idx); }
-    const char *get_key_and_data(int32_t idx) override
-    {
-        return get_key(idx);
-    }
-    bool lookup(const char *str, int32_t &idx, std::function<int(const char*,const char*)> cmp) override;
+    bool lookup(const char *str, int32_t &idx, std::function<int(const char*,const char*)> cmp, IndexCursor &cur) const override;
 
 private:
-    static const int ENTR_PER_PAGE = 32;
+    static const int ENTR_PER_PAGE = INDEX_ENTR_PER_PAGE;
     static const char *CACHE_MAGIC;
 
     std::vector<uint32_t> wordoffset;
-    FILE *idxfile;
+    // the whole .idx stays mapped, keys are returned as pointers into it.
+    MapFile idxmap;
+    const char *idxdata = nullptr;
+    const char *real_last_key = nullptr;
     uint32_t wordcount;
 
-    char wordentry_buf[256 + sizeof(uint32_t) * 2]; // The length of "word_str" should be less than 256. See src/tools/DICTFILE_FORMAT.
-    struct index_entry {
-        int32_t idx;
-        std::string keystr;
-        void assign(int32_t i, const std::string &str)
-        {
-            idx = i;
-            keystr.assign(str);
-        }
-    };
-    index_entry first, last, middle, real_last;
-
-    struct page_entry {
-        char *keystr;
-        uint32_t off, size;
-    };
-    std::vector<char> page_data;
-    struct page_t {
-        int32_t idx = -1;
-        page_entry entries[ENTR_PER_PAGE];
-
-        page_t() {}
-        void fill(char *data, int nent, int32_t idx_);
-    } page;
-    uint32_t load_page(int32_t page_idx);
-    const char *read_first_on_page_key(int32_t page_idx);
-    const char *get_first_on_page_key(int32_t page_idx);
+    void fill_page(IndexCursor &cur, int nent, int32_t idx_) const;
+    uint32_t load_page(int32_t page_idx, IndexCursor &cur) const;
+    const char *get_first_on_page_key(int32_t page_idx) const { return idxdata + wordoffset[page_idx]; }
     bool load_cache(const std::string &url);
-    bool save_cache(const std::string &url, bool verbose);
+    bool save_cache(const std::string &url, std::string *log);
     static std::list<std::string> get_cache_variant(const std::string &url);
 };
 
@@ -454,63 +583,37 @@ public:
     {
     }
     ~WordListIndex() { free(idxdatabuf); }
-    bool load(const std::string &url, uint32_t wc, uint32_t fsize, bool verbose) override;
-    const char *get_key(int32_t idx) override { return wordlist[idx]; }
-    void get_data(int32_t idx) override;
-    const char *get_key_and_data(int32_t idx) override
+    bool load(const std::string &url, uint32_t wc, uint32_t fsize, std::string *log) override;
+    const char *get_key(int32_t idx, IndexCursor &) const override { return wordlist[idx]; }
+    void get_data(int32_t idx, IndexCursor &cur) const override;
+    const char *get_key_and_data(int32_t idx, IndexCursor &cur) const override
     {
-        get_data(idx);
-        return get_key(idx);
+        get_data(idx, cur);
+        return get_key(idx, cur);
     }
-    bool lookup(const char *str, int32_t &idx, std::function<int(const char*,const char*)> cmp) override;
+    bool lookup(const char *str, int32_t &idx, std::function<int(const char*,const char*)> cmp, IndexCursor &cur) const override;
 
 private:
     char *idxdatabuf;
     std::vector<char *> wordlist;
 };
 
-void OffsetIndex::page_t::fill(char *data, int nent, int32_t idx_)
+void OffsetIndex::fill_page(IndexCursor &cur, int nent, int32_t idx_) const
 {
-    idx = idx_;
-    char *p = data;
+    cur.page_idx = idx_;
+    const char *p = idxdata + wordoffset[idx_];
     int32_t len;
     for (int i = 0; i < nent; ++i) {
-        entries[i].keystr = p;
+        cur.entries[i].keystr = p;
         len = strlen(p);
         p += len + 1;
-        entries[i].off = ntohl(get_uint32(p));
+        cur.entries[i].off = ntohl(get_uint32(p));
         p += sizeof(uint32_t);
-        entries[i].size = ntohl(get_uint32(p));
+        cur.entries[i].size = ntohl(get_uint32(p));
         p += sizeof(uint32_t);
     }
 }
 
-inline const char *OffsetIndex::read_first_on_page_key(int32_t page_idx)
-{
-    fseek(idxfile, wordoffset[page_idx], SEEK_SET);
-    uint32_t page_size = wordoffset[page_idx + 1] - wordoffset[page_idx];
-    const size_t nitems = fread(wordentry_buf,
-                                std::min(sizeof(wordentry_buf), static_cast<size_t>(page_size)),
-                                1, idxfile);
-    THROW_IF_ERROR(nitems == 1);
-    //TODO: check returned values, deal with word entry that strlen>255.
-    return wordentry_buf;
-}
-
-inline const char *OffsetIndex::get_first_on_page_key(int32_t page_idx)
-{
-    if (page_idx < middle.idx) {
-        if (page_idx == first.idx)
-            return first.keystr.c_str();
-        return read_first_on_page_key(page_idx);
-    } else if (page_idx > middle.idx) {
-        if (page_idx == last.idx)
-            return last.keystr.c_str();
-        return read_first_on_page_key(page_idx);
-    } else
-        return middle.keystr.c_str();
-}
-
 bool OffsetIndex::load_cache(const std::string &url)
 {
     const std::list<std::string> vars = get_cache_variant(url);
@@ -539,26 +642,10 @@ bool OffsetIndex::load_cache(const std::string &url)
 
 std::list<std::string> OffsetIndex::get_cache_variant(const std::string &url)
 {
-    std::list<std::string> res = { url + ".oft" };
-    if (access(g_get_user_cache_dir().c_str(), R_OK|W_OK|X_OK) && mkdir(g_get_user_cache_dir().c_str(), 0700) == -1)
-        return res;
-
-    const std::string cache_dir(g_get_user_cache_dir() + G_DIR_SEPARATOR + "sdwv");
-
-    if (access(cache_dir.c_str(), R_OK|W_OK|X_OK)) {
-        if (mkdir(cache_dir.c_str(), 0700) == -1)
-            return res;
-    } else if (access(cache_dir.c_str(), R_OK|W_OK|X_OK))
-        return res;
-
-    char *u = strdup(url.c_str());
-    const char *base = basename(u);
-    res.push_back(cache_dir + G_DIR_SEPARATOR + base + ".oft");
-    free(u);
-    return res;
+    return cache_variants(url, ".oft");
 }
 
-bool OffsetIndex::save_cache(const std::string &url, bool verbose)
+bool OffsetIndex::save_cache(const std::string &url, std::string *log)
 {
     const std::list<std::string> vars = get_cache_variant(url);
     for (const std::string &item : vars) {
@@ -573,24 +660,25 @@ bool OffsetIndex::save_cache(const std::string &url, bool verbose)
         if (fwrite(&wordoffset[0], sizeof(wordoffset[0]), wordoffset.size(), out) != wordoffset.size())
             continue;
         fclose(out);
-        if (verbose) {
-            printf("save to cache %s\n", url.c_str());
-        }
+        if (log)
+            *log += "save to cache " + url + "\n";
         return true;
     }
     return false;
 }
 
-bool OffsetIndex::load(const std::string &url, uint32_t wc, uint32_t fsize, bool verbose)
+bool OffsetIndex::load(const std::string &url, uint32_t wc, uint32_t fsize, std::string *log)
 {
     wordcount = wc;
     uint32_t npages = (wc - 1) / ENTR_PER_PAGE + 2;
     wordoffset.resize(npages);
-    if (!load_cache(url)) { //map file will close after finish of block
-        MapFile map_file;
-        if (!map_file.open(url.c_str(), fsize))
-            return false;
-        const char *idxdatabuffer = map_file.begin();
+    if (!idxmap.open(url.c_str(), fsize)) {
+        wordoffset.resize(0);
+        return false;
+    }
+    idxdata = idxmap.begin();
+    if (!load_cache(url)) {
+        const char *idxdatabuffer = idxdata;
 
         const char *p1 = idxdatabuffer;
         uint32_t index_size;
@@ -604,63 +692,53 @@ bool OffsetIndex::load(const std::string &url, uint32_t wc, uint32_t fsize, bool
             p1 += index_size;
         }
         wordoffset[j] = p1 - idxdatabuffer;
-        if (!save_cache(url, verbose))
-            printf("cache update failed\n");
+        if (!save_cache(url, log) && log)
+            *log += "cache update failed\n";
     }
 
-    if (!(idxfile = fopen(url.c_str(), "rb"))) {
-        wordoffset.resize(0);
-        return false;
-    }
-
-    first.assign(0, read_first_on_page_key(0));
-    last.assign(wordoffset.size() - 2, read_first_on_page_key(wordoffset.size() - 2));
-    middle.assign((wordoffset.size() - 2) / 2, read_first_on_page_key((wordoffset.size() - 2) / 2));
-    real_last.assign(wc - 1, get_key(wc - 1));
+    IndexCursor cur;
+    real_last_key = get_key(wc - 1, cur);
 
     return true;
 }
 
-inline uint32_t OffsetIndex::load_page(int32_t page_idx)
+inline uint32_t OffsetIndex::load_page(int32_t page_idx, IndexCursor &cur) const
 {
     uint32_t nentr = ENTR_PER_PAGE;
     if (page_idx == int32_t(wordoffset.size() - 2))
         if ((nentr = (wordcount % ENTR_PER_PAGE)) == 0)
             nentr = ENTR_PER_PAGE;
 
-    if (page_idx != page.idx) {
-        page_data.resize(wordoffset[page_idx + 1] - wordoffset[page_idx]);
-        fseek(idxfile, wordoffset[page_idx], SEEK_SET);
-        const size_t nitems = fread(&page_data[0], 1, page_data.size(), idxfile);
-        THROW_IF_ERROR(nitems == page_data.size());
-
-        page.fill(&page_data[0], nentr, page_idx);
-    }
+    if (page_idx != cur.page_idx) {
+        ++cur.page_misses;
+        fill_page(cur, nentr, page_idx);
+    } else
+        ++cur.page_hits;
 
     return nentr;
 }
 
-const char *OffsetIndex::get_key(int32_t idx)
+const char *OffsetIndex::get_key(int32_t idx, IndexCursor &cur) const
 {
-    load_page(idx / ENTR_PER_PAGE);
+    load_page(idx / ENTR_PER_PAGE, cur);
     int32_t idx_in_page = idx % ENTR_PER_PAGE;
-    wordentry_offset = page.entries[idx_in_page].off;
-    wordentry_size = page.entries[idx_in_page].size;
+    cur.wordentry_offset = cur.entries[idx_in_page].off;
+    cur.wordentry_size = cur.entries[idx_in_page].size;
 
-    return page.entries[idx_in_page].keystr;
+    return cur.entries[idx_in_page].keystr;
 }
 
-bool OffsetIndex::lookup(const char *str, int32_t &idx, std::function<int(const char*,const char*)> cmp)
+bool OffsetIndex::lookup(const char *str, int32_t &idx, std::function<int(const char*,const char*)> cmp, IndexCursor &cur) const
 {
     bool bFound = false;
     int32_t iFrom;
     int32_t iTo = wordoffset.size() - 2;
     int cmpint;
     int32_t iThisIndex;
-    if (cmp(str, first.keystr.c_str()) < 0) {
+    if (cmp(str, get_first_on_page_key(0)) < 0) {
         idx = 0;
         return false;
-    } else if (cmp(str, real_last.keystr.c_str()) > 0) {
+    } else if (cmp(str, real_last_key) > 0) {
         idx = INVALID_INDEX;
         return false;
     } else {
@@ -684,13 +762,13 @@ bool OffsetIndex::lookup(const char *str, int32_t &idx, std::function<int(const
             idx = iThisIndex;
     }
     if (!bFound) {
-        uint32_t netr = load_page(idx);
+        uint32_t netr = load_page(idx, cur);
         iFrom = 1; // Needn't search the first word anymore.
         iTo = netr - 1;
         iThisIndex = 0;
         while (iFrom <= iTo) {
             iThisIndex = (iFrom + iTo) / 2;
-            cmpint = cmp(str, page.entries[iThisIndex].keystr);
+            cmpint = cmp(str, cur.entries[iThisIndex].keystr);
             if (cmpint > 0)
                 iFrom = iThisIndex + 1;
             else if (cmpint < 0)
@@ -711,7 +789,7 @@ bool OffsetIndex::lookup(const char *str, int32_t &idx, std::function<int(const
     return bFound;
 }
 
-bool WordListIndex::load(const std::string &url, uint32_t wc, uint32_t fsize, bool/* verbose*/)
+bool WordListIndex::load(const std::string &url, uint32_t wc, uint32_t fsize, std::string */* log*/)
 {
     gzFile in = gzopen(url.c_str(), "rb");
     if (in == nullptr)
@@ -739,22 +817,22 @@ bool WordListIndex::load(const std::string &url, uint32_t wc, uint32_t fsize, bo
     return true;
 }
 
-void WordListIndex::get_data(int32_t idx)
+void WordListIndex::get_data(int32_t idx, IndexCursor &cur) const
 {
     char *p1 = wordlist[idx] + strlen(wordlist[idx]) + sizeof(char);
-    wordentry_offset = ntohl(get_uint32(p1));
+    cur.wordentry_offset = ntohl(get_uint32(p1));
     p1 += sizeof(uint32_t);
-    wordentry_size = ntohl(get_uint32(p1));
+    cur.wordentry_size = ntohl(get_uint32(p1));
 }
 
-bool WordListIndex::lookup(const char *str, int32_t &idx, std::function<int(const char*,const char*)> cmp)
+bool WordListIndex::lookup(const char *str, int32_t &idx, std::function<int(const char*,const char*)> cmp, IndexCursor &cur) const
 {
     bool bFound = false;
     int32_t iTo = wordlist.size() - 2;
 
-    if (cmp(str, get_key(0)) < 0) {
+    if (cmp(str, get_key(0, cur)) < 0) {
         idx = 0;
-    } else if (cmp(str, get_key(iTo)) > 0) {
+    } else if (cmp(str, get_key(iTo, cur)) > 0) {
         idx = INVALID_INDEX;
     } else {
         int32_t iThisIndex = 0;
@@ -762,7 +840,7 @@ bool WordListIndex::lookup(const char *str, int32_t &idx, std::function<int(cons
         int cmpint;
         while (iFrom <= iTo) {
             iThisIndex = (iFrom + iTo) / 2;
-            cmpint = cmp(str, get_key(iThisIndex));
+            cmpint = cmp(str, get_key(iThisIndex, cur));
             if (cmpint > 0)
                 iFrom = iThisIndex + 1;
             else if (cmpint < 0)
@@ -784,45 +862,62 @@ bool WordListIndex::lookup(const char *str, int32_t &idx, std::function<int(cons
 bool SynFile::load(const std::string &url, uint32_t wc)
 {
     struct stat stat_buf;
-    if (!stat(url.c_str(), &stat_buf)) {
-        MapFile syn;
-        if (!syn.open(url.c_str(), stat_buf.st_size))
-            return false;
-        const char *current = syn.begin();
-        for (unsigned long i = 0; i < wc; i++) {
-            // each entry in a syn-file is:
-            // - 0-terminated string
-            // 4-byte index into .dict file in network byte order
-            std::string synonym(current);
-            current += synonym.length() + 1;
-            const uint32_t idx = ntohl(get_uint32(current));
-            current += sizeof(idx);
-            synonyms[synonym] = idx;
-        }
-        return true;
-    } else {
+    if (stat(url.c_str(), &stat_buf) || stat_buf.st_size == 0 || !synmap.open(url.c_str(), stat_buf.st_size))
         return false;
+    syndata = synmap.begin();
+    const char *current = syndata, *end = syndata + stat_buf.st_size;
+    entries.reserve(wc);
+    bool sorted = true;
+    for (unsigned long i = 0; i < wc; i++) {
+        // each entry in a syn-file is:
+        // - 0-terminated string
+        // 4-byte index into .dict file in network byte order
+        const size_t len = strnlen(current, end - current);
+        if (size_t(end - current) < len + 1 + sizeof(uint32_t))
+            break;
+        if (!entries.empty() && sorted && strcmp(syndata + entries.back(), current) > 0)
+            sorted = false;
+        entries.push_back(current - syndata);
+        current += len + 1 + sizeof(uint32_t);
+    }
+    // .syn files are usually sorted ignoring case first.
+    if (!sorted) {
+        std::stable_sort(entries.begin(), entries.end(), [this](uint32_t a, uint32_t b) {
+            return strcmp(syndata + a, syndata + b) < 0;
+        });
     }
+    return true;
 }
 
-bool SynFile::lookup(const char *str, int32_t &idx)
+// strcmp of key and str in lower case.
+static int synonym_cmp(const char *key, const char *str)
 {
-    char *lower_string = g_utf8_strdown(str);
-    auto it = synonyms.find((lower_string));
-    free(lower_string);
-    if (it != synonyms.end()) {
-        idx = it->second;
-        return true;
+    for (;; ++key, ++str) {
+        const unsigned char k = *key, s = static_cast<char>(tolower(*str));
+        if (k != s || !k)
+            return k - s;
     }
-    return false;
 }
 
-bool Dict::Lookup(const char *str, int32_t &idx, bool ignorecase)
+bool SynFile::lookup(const char *str, int32_t &idx) const
 {
-    return syn_file->lookup(str, idx) || idx_file->lookup(str, idx, ignorecase ? strcasecmp : stardict_strcmp);
+    // the last of the entries with the key wins.
+    const auto it = std::upper_bound(entries.begin(), entries.end(), str, [this](const char *s, uint32_t e) {
+        return synonym_cmp(syndata + e, s) > 0;
+    });
+    if (it == entries.begin() || synonym_cmp(syndata + *(it - 1), str) != 0)
+        return false;
+    const char *key = syndata + *(it - 1);
+    idx = ntohl(get_uint32(key + strlen(key) + 1));
+    return true;
 }
 
-bool Dict::load(const std::string &ifofilename, bool verbose)
+bool Dict::Lookup(const char *str, int32_t &idx, bool ignorecase, IndexCursor &cur) const
+{
+    return syn_file->lookup(str, idx) || idx_file->lookup(str, idx, ignorecase ? strcasecmp : stardict_strcmp, cur);
+}
+
+bool Dict::load(const std::string &ifofilename, std::string *log)
 {
     uint32_t idxfilesize;
     if (!load_ifofile(ifofilename, idxfilesize))
@@ -839,11 +934,19 @@ bool Dict::load(const std::string &ifofilename, bool verbose)
         }
     } else {
         fullfilename = basefilename + "dict";
-        dictfile = fopen(fullfilename.c_str(), "rb");
-        if (!dictfile) {
+        struct stat st;
+        if (stat(fullfilename.c_str(), &st) != 0) {
             //g_print("open file %s failed!\n",fullfilename);
             return false;
         }
+        dictsize = st.st_size;
+        if (dictsize == 0) {
+            dictdata = "";
+        } else if (dictfile.open(fullfilename.c_str(), dictsize)) {
+            dictdata = dictfile.begin();
+        } else {
+            return false;
+        }
     }
 
     fullfilename = basefilename + "idx.gz";
@@ -854,7 +957,7 @@ bool Dict::load(const std::string &ifofilename, bool verbose)
         idx_file.reset(new OffsetIndex);
     }
 
-    if (!idx_file->load(fullfilename, wordcount, idxfilesize, verbose))
+    if (!idx_file->load(fullfilename, wordcount, idxfilesize, log))
         return false;
 
     fullfilename = basefilename + "syn";
@@ -865,6 +968,125 @@ bool Dict::load(const std::string &ifofilename, bool verbose)
     return true;
 }
 
+const std::vector<uint32_t> &Dict::offset_order(IndexCursor &cur) const
+{
+    std::call_once(offset_order_once, [this, &cur]() {
+        std::vector<uint32_t> offsets(wordcount);
+        bool sorted = true;
+        for (uint32_t i = 0; i < wordcount; i++) {
+            idx_file->get_data(i, cur);
+            offsets[i] = cur.wordentry_offset;
+            if (i > 0 && offsets[i] < offsets[i - 1])
+                sorted = false;
+        }
+        if (sorted)
+            return;
+        by_offset.resize(wordcount);
+        for (uint32_t i = 0; i < wordcount; i++)
+            by_offset[i] = i;
+        std::stable_sort(by_offset.begin(), by_offset.end(), [&offsets](uint32_t a, uint32_t b) {
+            return offsets[a] < offsets[b];
+        });
+    });
+    return by_offset;
+}
+
+void Dict::ScanData(TermMatcher &SearchWords, std::vector<uint32_t> &res, IndexCursor &cur,
+                    DictReadContext &dzctx) const
+{
+    res.clear();
+    if (dictdata) {
+        for (uint32_t i = 0; i < wordcount; i++) {
+            idx_file->get_data(i, cur);
+            if (holds_all(SearchWords, map_data(cur.wordentry_offset, cur.wordentry_size), cur.wordentry_size))
+                res.push_back(i);
+        }
+        return;
+    }
+    DictScanner scanner(*dictdzfile, dzctx);
+    const auto &visit = [&](uint32_t i) {
+        idx_file->get_data(i, cur);
+        if (holds_all(SearchWords, scanner.read(cur.wordentry_offset, cur.wordentry_size), cur.wordentry_size))
+            res.push_back(i);
+    };
+    const std::vector<uint32_t> &order = offset_order(cur);
+    if (order.empty()) {
+        for (uint32_t i = 0; i < wordcount; i++)
+            visit(i);
+        return;
+    }
+    for (const uint32_t i : order)
+        visit(i);
+    std::sort(res.begin(), res.end());
+}
+
+bool Dict::load_token_index(std::string *log)
+{
+    if (!containSearchData())
+        return false;
+    const std::string basefilename(ifo_file_name, 0, ifo_file_name.size() - (sizeof("ifo") - 1));
+    std::string idxfilename(basefilename + "idx.gz");
+    if (access(idxfilename.c_str(), R_OK))
+        idxfilename = basefilename + "idx";
+    // the index is out of date once the .idx or the .dict is newer.
+    time_t newest = 0;
+    for (const std::string &name : {idxfilename, basefilename + (dictdata ? "dict" : "dict.dz")}) {
+        struct stat st;
+        if (stat(name.c_str(), &st) == 0 && st.st_mtime > newest)
+            newest = st.st_mtime;
+    }
+
+    const std::list<std::string> vars = cache_variants(idxfilename, ".tix");
+    for (const std::string &item : vars) {
+        std::unique_ptr<TokenIndex> index(new TokenIndex);
+        if (index->load(item, wordcount, newest)) {
+            token_index = std::move(index);
+            return true;
+        }
+    }
+
+    TokenIndex::Builder builder;
+    try {
+        DictReadContext dzctx;
+        IndexCursor cur;
+        std::vector<char> buffer;
+        for (uint32_t i = 0; i < wordcount; ++i) {
+            const char *key;
+            uint32_t offset, size;
+            get_key_and_data(i, &key, &offset, &size, cur);
+            const char *data;
+            if (dictdata) {
+                data = map_data(offset, size);
+            } else {
+                if (buffer.size() < size)
+                    buffer.resize(size);
+                dictdzfile->read(dzctx, buffer.data(), offset, size);
+                data = buffer.data();
+            }
+            for_each_search_text(sametypesequence, data, data + size, [&builder, i](const char *p, size_t len) {
+                builder.add(i, p, len);
+                return false;
+            });
+        }
+    } catch (const std::runtime_error &e) {
+        if (log)
+            *log += "token index of " + ifo_file_name + " failed: " + e.what() + "\n";
+        return false;
+    }
+    for (const std::string &item : vars) {
+        std::unique_ptr<TokenIndex> index(new TokenIndex);
+        if (builder.save(item, wordcount) && index->load(item, wordcount, newest)) {
+            if (log)
+                *log += "save to cache " + item + "\n";
+            token_index = std::move(index);
+            return true;
+        }
+    }
+    if (log)
+        *log += "token index update failed\n";
+    return false;
+}
+
 bool Dict::load_ifofile(const std::string &ifofilename, uint32_t &idxfilesize)
 {
     const auto &&ifo = load_from_ifo_file(ifofilename, false);
@@ -894,46 +1116,107 @@ bool Dict::load_ifofile(const std::string &ifofilename, uint32_t &idxfilesize)
     return true;
 }
 
-bool Dict::LookupWithRule(const std::regex &spec, int32_t *aIndex, int iBuffLen)
+bool Dict::LookupWithRule(const GlobPattern &spec, int32_t *aIndex, int iBuffLen, IndexCursor &cur) const
 {
     int iIndexCount = 0;
+    int32_t from = 0, to = narticles();
+    const std::string &prefix = spec.prefix();
+    if (!prefix.empty() && lower_sorted(cur)) {
+        const size_t n = prefix.size();
+        // the compares never give 0, so lookup() ends on the first key after
+        // those before the prefix, then on the first one after the prefix.
+        idx_file->lookup(prefix.c_str(), from, [n](const char *s, const char *key) {
+            return strncasecmp(s, key, n) > 0 ? 1 : -1;
+        }, cur);
+        idx_file->lookup(prefix.c_str(), to, [n](const char *s, const char *key) {
+            return strncasecmp(s, key, n) < 0 ? -1 : 1;
+        }, cur);
+        if (from == INVALID_INDEX)
+            from = narticles();
+        if (to == INVALID_INDEX)
+            to = narticles();
+    }
 
-    for (uint32_t i = 0; i < narticles() && iIndexCount < (iBuffLen - 1); i++)
-        if (std::regex_match(get_key(i), spec))
-        //if (g_pattern_match_string(pspec, get_key(i)))
+    for (int32_t i = from; i < to && iIndexCount < (iBuffLen - 1); i++)
+        if (spec.match(get_key(i, cur)))
             aIndex[iIndexCount++] = i;
 
     aIndex[iIndexCount] = -1; // -1 is the end.
     return iIndexCount > 0;
 }
 
-Libs::~Libs()
+bool Dict::lower_sorted(IndexCursor &cur) const
 {
-    for (Dict *p : oLib)
-        delete p;
+    std::call_once(lower_sorted_once, [this, &cur]() {
+        // keys stay where they are in the index, no need to copy them.
+        const char *prev = narticles() > 0 ? get_key(0, cur) : nullptr;
+        for (uint32_t i = 1; i < narticles(); i++) {
+            const char *key = get_key(i, cur);
+            const unsigned char *a = reinterpret_cast<const unsigned char *>(prev);
+            const unsigned char *b = reinterpret_cast<const unsigned char *>(key);
+            while (*a && char(tolower(*a)) == char(tolower(*b))) {
+                ++a;
+                ++b;
+            }
+            if (static_cast<unsigned char>(tolower(*a)) > static_cast<unsigned char>(tolower(*b)))
+                return;
+            prev = key;
+        }
+        is_lower_sorted = true;
+    });
+    return is_lower_sorted;
 }
 
-bool Libs::load_dict(const std::string &url)
+Libs::~Libs()
 {
-    Dict *lib = new Dict;
-    if (lib->load(url, true)) {
-        oLib.push_back(lib);
-        return true;
-    }
-    delete lib;
-    return false;
+    for (Dict *p : oLib)
+        delete p;
 }
 
 void Libs::load(const std::list<std::string> &dicts_dirs,
                 const std::list<std::string> &order_list,
                 const std::list<std::string> &disable_list)
 {
-    int order_cnt = 0;
+    std::vector<std::pair<std::string, bool>> urls;
     for_each_file(dicts_dirs, ".ifo", order_list, disable_list,
-                  [this, &order_cnt](const std::string &url, bool ordered) {
-                      if (load_dict(url) && ordered)
-                          order_cnt++;
+                  [&urls](const std::string &url, bool ordered) {
+                      urls.emplace_back(url, ordered);
                   });
+
+    // dictionaries do not share anything while loading, load them all at
+    // once and keep them, and what they have to say, in the order they
+    // were found.
+    std::vector<std::unique_ptr<Dict>> loaded(urls.size());
+    std::vector<std::string> logs(urls.size());
+    std::vector<double> load_ms(urls.size());
+    const auto load_start = std::chrono::steady_clock::now();
+    parallel_for(urls.size(), std::thread::hardware_concurrency(), [&](size_t n) {
+        const auto start = std::chrono::steady_clock::now();
+        std::unique_ptr<Dict> lib(new Dict);
+        if (lib->load(urls[n].first, &logs[n])) {
+            if (param_.token_index)
+                lib->load_token_index(&logs[n]);
+            loaded[n] = std::move(lib);
+        }
+        load_ms[n] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    });
+
+    int order_cnt = 0;
+    for (size_t n = 0; n < urls.size(); ++n) {
+        fputs(logs[n].c_str(), stdout);
+        if (param_.load_report)
+            printf("%8.1f ms  %s %s\n", load_ms[n], loaded[n] ? "loaded" : "failed", urls[n].first.c_str());
+        if (!loaded[n])
+            continue;
+        oLib.push_back(loaded[n].release());
+        if (urls[n].second)
+            order_cnt++;
+    }
+    if (param_.load_report)
+        printf("%8.1f ms  total, %zu of %zu dictionaries\n",
+               std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - load_start).count(),
+               oLib.size(), urls.size());
+
     auto i = oLib.begin();
     while (--order_cnt >= 0)
         ++i;
@@ -945,7 +1228,7 @@ void Libs::load(const std::list<std::string> &dicts_dirs,
     });
 }
 
-const char *Libs::poGetCurrentWord(int32_t *iCurrent)
+const char *Libs::poGetCurrentWord(int32_t *iCurrent, QueryContext &ctx) const
 {
     const char *poCurrentWord = nullptr;
     const char *word;
@@ -955,9 +1238,9 @@ const char *Libs::poGetCurrentWord(int32_t *iCurrent)
         if (iCurrent[iLib] >= narticles(iLib) || iCurrent[iLib] < 0)
             continue;
         if (poCurrentWord == nullptr) {
-            poCurrentWord = poGetWord(iCurrent[iLib], iLib);
+            poCurrentWord = poGetWord(iCurrent[iLib], iLib, ctx);
         } else {
-            word = poGetWord(iCurrent[iLib], iLib);
+            word = poGetWord(iCurrent[iLib], iLib, ctx);
 
             if (stardict_strcmp(poCurrentWord, word) > 0)
                 poCurrentWord = word;
@@ -966,7 +1249,7 @@ const char *Libs::poGetCurrentWord(int32_t *iCurrent)
     return poCurrentWord;
 }
 
-const char *Libs::poGetNextWord(const char *sWord, int32_t *iCurrent)
+const char *Libs::poGetNextWord(const char *sWord, int32_t *iCurrent, QueryContext &ctx) const
 {
     // the input can be:
     // (word,iCurrent),read word,write iNext to iCurrent,and return next word. used by TopWin::NextCallback();
@@ -977,16 +1260,16 @@ const char *Libs::poGetNextWord(const char *sWord, int32_t *iCurrent)
 
     for (uint32_t iLib = 0; iLib < oLib.size(); ++iLib) {
         if (sWord)
-            oLib[iLib]->Lookup(sWord, iCurrent[iLib], false);
+            oLib[iLib]->Lookup(sWord, iCurrent[iLib], false, ctx.cursor(iLib));
         if (iCurrent[iLib] == INVALID_INDEX)
             continue;
         if (iCurrent[iLib] >= narticles(iLib) || iCurrent[iLib] < 0)
             continue;
         if (poCurrentWord == nullptr) {
-            poCurrentWord = poGetWord(iCurrent[iLib], iLib);
+            poCurrentWord = poGetWord(iCurrent[iLib], iLib, ctx);
             iCurrentLib = iLib;
         } else {
-            word = poGetWord(iCurrent[iLib], iLib);
+            word = poGetWord(iCurrent[iLib], iLib, ctx);
 
             if (stardict_strcmp(poCurrentWord, word) > 0) {
                 poCurrentWord = word;
@@ -1003,16 +1286,16 @@ const char *Libs::poGetNextWord(const char *sWord, int32_t *iCurrent)
                 continue;
             if (iCurrent[iLib] >= narticles(iLib) || iCurrent[iLib] < 0)
                 continue;
-            if (strcmp(poCurrentWord, poGetWord(iCurrent[iLib], iLib)) == 0)
+            if (strcmp(poCurrentWord, poGetWord(iCurrent[iLib], iLib, ctx)) == 0)
                 iCurrent[iLib]++;
         }
-        poCurrentWord = poGetCurrentWord(iCurrent);
+        poCurrentWord = poGetCurrentWord(iCurrent, ctx);
     }
     return poCurrentWord;
 }
 
 const char *
-Libs::poGetPreWord(int32_t *iCurrent)
+Libs::poGetPreWord(int32_t *iCurrent, QueryContext &ctx) const
 {
     // used by TopWin::PreviousCallback(); the iCurrent is cached by AppCore::TopWinWordChange();
     const char *poCurrentWord = nullptr;
@@ -1027,10 +1310,10 @@ Libs::poGetPreWord(int32_t *iCurrent)
                 continue;
         }
         if (poCurrentWord == nullptr) {
-            poCurrentWord = poGetWord(iCurrent[iLib] - 1, iLib);
+            poCurrentWord = poGetWord(iCurrent[iLib] - 1, iLib, ctx);
             iCurrentLib = iLib;
         } else {
-            word = poGetWord(iCurrent[iLib] - 1, iLib);
+            word = poGetWord(iCurrent[iLib] - 1, iLib, ctx);
             if (stardict_strcmp(poCurrentWord, word) < 0) {
                 poCurrentWord = word;
                 iCurrentLib = iLib;
@@ -1045,7 +1328,7 @@ Libs::poGetPreWord(int32_t *iCurrent)
                 continue;
             if (iCurrent[iLib] > narticles(iLib) || iCurrent[iLib] <= 0)
                 continue;
-            if (strcmp(poCurrentWord, poGetWord(iCurrent[iLib] - 1, iLib)) == 0) {
+            if (strcmp(poCurrentWord, poGetWord(iCurrent[iLib] - 1, iLib, ctx)) == 0) {
                 iCurrent[iLib]--;
             } else {
                 if (iCurrent[iLib] == narticles(iLib))
@@ -1056,13 +1339,14 @@ Libs::poGetPreWord(int32_t *iCurrent)
     return poCurrentWord;
 }
 
-bool Libs::LookupSimilarWord(const char *sWord, int32_t &iWordIndex, int iLib)
+bool Libs::LookupSimilarWord(const char *sWord, int32_t &iWordIndex, int iLib, QueryContext &ctx) const
 {
+    IndexCursor &cur = ctx.cursor(iLib);
     int32_t iIndex;
     bool bFound;
 
     // to lower case.
-    bFound = oLib[iLib]->Lookup(sWord, iIndex, true);
+    bFound = oLib[iLib]->Lookup(sWord, iIndex, true, cur);
 
     if (bIsPureEnglish(sWord)) {
         // If not Found , try other status of sWord.
@@ -1075,7 +1359,7 @@ bool Libs::LookupSimilarWord(const char *sWord, int32_t &iWordIndex, int iLib)
             if (sWord[iWordLen - 1] == 'S' || sWord[iWordLen - 1] == 's'|| !strncasecmp(&sWord[iWordLen - 2], "ed", 2)) {
                 strcpy(sNewWord, sWord);
                 sNewWord[iWordLen - 1] = '\0'; // cut "s" or "d"
-                bFound = oLib[iLib]->Lookup(sNewWord, iIndex, true);
+                bFound = oLib[iLib]->Lookup(sNewWord, iIndex, true, cur);
             }
         }
 
@@ -1088,12 +1372,12 @@ bool Libs::LookupSimilarWord(const char *sWord, int32_t &iWordIndex, int iLib)
                     && !bIsVowel(sNewWord[iWordLen - 4]) && bIsVowel(sNewWord[iWordLen - 5])) { //doubled
 
                     sNewWord[iWordLen - 3] = '\0';
-                    bFound = oLib[iLib]->Lookup(sNewWord, iIndex, true);
+                    bFound = oLib[iLib]->Lookup(sNewWord, iIndex, true, cur);
                     if (!bFound)
                         sNewWord[iWordLen - 3] = sNewWord[iWordLen - 4]; //restore
                 }
                 if (!bFound) {
-                    bFound = oLib[iLib]->Lookup(sNewWord, iIndex, true);
+                    bFound = oLib[iLib]->Lookup(sNewWord, iIndex, true, cur);
                 }
             }
         }
@@ -1106,16 +1390,16 @@ bool Libs::LookupSimilarWord(const char *sWord, int32_t &iWordIndex, int iLib)
                 if (iWordLen > 6 && (sNewWord[iWordLen - 4] == sNewWord[iWordLen - 5])
                     && !bIsVowel(sNewWord[iWordLen - 5]) && bIsVowel(sNewWord[iWordLen - 6])) { //doubled
                     sNewWord[iWordLen - 4] = '\0';
-                    bFound = oLib[iLib]->Lookup(sNewWord, iIndex, true);
+                    bFound = oLib[iLib]->Lookup(sNewWord, iIndex, true, cur);
                     if (!bFound)
                         sNewWord[iWordLen - 4] = sNewWord[iWordLen - 5]; //restore
                 }
                 if (!bFound) {
-                    bFound = oLib[iLib]->Lookup(sNewWord, iIndex, true);
+                    bFound = oLib[iLib]->Lookup(sNewWord, iIndex, true, cur);
                 }
                 if (!bFound) {
                     strcat(sNewWord, "e"); // add a char "e"
-                    bFound = oLib[iLib]->Lookup(sNewWord, iIndex, true);
+                    bFound = oLib[iLib]->Lookup(sNewWord, iIndex, true, cur);
                 }
             }
         }
@@ -1129,7 +1413,7 @@ bool Libs::LookupSimilarWord(const char *sWord, int32_t &iWordIndex, int iLib)
                     (sWord[iWordLen - 4] == 'c' || sWord[iWordLen - 4] == 's' || sWord[iWordLen - 4] == 'C' || sWord[iWordLen - 4] == 'S'))))) {
                 strcpy(sNewWord, sWord);
                 sNewWord[iWordLen - 2] = '\0';
-                bFound = oLib[iLib]->Lookup(sNewWord, iIndex, true);
+                bFound = oLib[iLib]->Lookup(sNewWord, iIndex, true, cur);
             }
         }
 
@@ -1141,12 +1425,12 @@ bool Libs::LookupSimilarWord(const char *sWord, int32_t &iWordIndex, int iLib)
                 if (iWordLen > 5 && (sNewWord[iWordLen - 3] == sNewWord[iWordLen - 4])
                     && !bIsVowel(sNewWord[iWordLen - 4]) && bIsVowel(sNewWord[iWordLen - 5])) { //doubled
                     sNewWord[iWordLen - 3] = '\0';
-                    bFound = oLib[iLib]->Lookup(sNewWord, iIndex, true);
+                    bFound = oLib[iLib]->Lookup(sNewWord, iIndex, true, cur);
                     if (!bFound)
                         sNewWord[iWordLen - 3] = sNewWord[iWordLen - 4]; //restore
                 }
                 if (!bFound) {
-                    bFound = oLib[iLib]->Lookup(sNewWord, iIndex, true);
+                    bFound = oLib[iLib]->Lookup(sNewWord, iIndex, true, cur);
                 }
             }
         }
@@ -1157,7 +1441,7 @@ bool Libs::LookupSimilarWord(const char *sWord, int32_t &iWordIndex, int iLib)
                 strcpy(sNewWord, sWord);
                 sNewWord[iWordLen - 3] = '\0';
                 strcat(sNewWord, "y"); // add a char "y"
-                bFound = oLib[iLib]->Lookup(sNewWord, iIndex, true);
+                bFound = oLib[iLib]->Lookup(sNewWord, iIndex, true, cur);
             }
         }
 
@@ -1167,7 +1451,7 @@ bool Libs::LookupSimilarWord(const char *sWord, int32_t &iWordIndex, int iLib)
                 strcpy(sNewWord, sWord);
                 sNewWord[iWordLen - 3] = '\0';
                 strcat(sNewWord, "y"); // add a char "y"
-                bFound = oLib[iLib]->Lookup(sNewWord, iIndex, true);
+                bFound = oLib[iLib]->Lookup(sNewWord, iIndex, true, cur);
             }
         }
 
@@ -1176,7 +1460,7 @@ bool Libs::LookupSimilarWord(const char *sWord, int32_t &iWordIndex, int iLib)
             if (!strncasecmp(&sWord[iWordLen - 2], "er", 2)) {
                 strcpy(sNewWord, sWord);
                 sNewWord[iWordLen - 2] = '\0';
-                bFound = oLib[iLib]->Lookup(sNewWord, iIndex, true);
+                bFound = oLib[iLib]->Lookup(sNewWord, iIndex, true, cur);
             }
         }
 
@@ -1185,7 +1469,7 @@ bool Libs::LookupSimilarWord(const char *sWord, int32_t &iWordIndex, int iLib)
             if (!strncasecmp(&sWord[iWordLen - 3], "est", 3)) {
                 strcpy(sNewWord, sWord);
                 sNewWord[iWordLen - 3] = '\0';
-                bFound = oLib[iLib]->Lookup(sNewWord, iIndex, true);
+                bFound = oLib[iLib]->Lookup(sNewWord, iIndex, true, cur);
             }
         }
 
@@ -1204,36 +1488,21 @@ bool Libs::LookupSimilarWord(const char *sWord, int32_t &iWordIndex, int iLib)
     return bFound;
 }
 
-bool Libs::SimpleLookupWord(const char *sWord, int32_t &iWordIndex, int iLib)
+bool Libs::SimpleLookupWord(const char *sWord, int32_t &iWordIndex, int iLib, QueryContext &ctx) const
 {
-    bool bFound = oLib[iLib]->Lookup(sWord, iWordIndex, false);
+    bool bFound = oLib[iLib]->Lookup(sWord, iWordIndex, false, ctx.cursor(iLib));
 
     if (!bFound && !param_.no_fuzzy)
-        bFound = LookupSimilarWord(sWord, iWordIndex, iLib);
+        bFound = LookupSimilarWord(sWord, iWordIndex, iLib, ctx);
     return bFound;
 }
 
-bool Libs::LookupWithFuzzy(const char *sWord, char *reslist[], int reslist_size)
+bool Libs::LookupWithFuzzy(const char *sWord, char *reslist[], int reslist_size, QueryContext &ctx) const
 {
-#if 1
     if (sWord[0] == '\0')
         return false;
-#define TCH char
-    std::vector<Fuzzystruct> oFuzzystruct(reslist_size);
-    //Fuzzystruct oFuzzystruct[reslist_size];
-
-    for (int i = 0; i < reslist_size; i++) {
-        oFuzzystruct[i].pMatchWord = nullptr;
-        oFuzzystruct[i].iMatchWordDistance = iMaxFuzzyDistance;
-    }
-    int iMaxDistance = iMaxFuzzyDistance;
-    int iDistance;
-    bool Found = false;
-    EditDistance oEditDistance;
 
-    int32_t iCheckWordLen;
-    const char *sCheck;
-    TCH *ucs4_str1, *ucs4_str2;
+    char *ucs4_str2;
     int32_t ucs4_str2_len;
 
 #if 0
@@ -1245,116 +1514,121 @@ bool Libs::LookupWithFuzzy(const char *sWord, char *reslist[], int reslist_size)
     ucs4_str2_len = strlen(ucs4_str2);
 #endif
 
+    // the query is compiled once, candidates are scanned against it.
+    const BitParallelDistance oEditDistance(ucs4_str2);
+
+    // index range [lo, hi) of a dictionary, scanned by one thread.
+    struct FuzzyTask {
+        size_t iLib;
+        int32_t lo, hi;
+        bool trie;
+    };
+    unsigned nthreads = fuzzy_pool_->size();
+    int64_t total = 0;
+    for (size_t iLib = 0; iLib < oLib.size(); ++iLib)
+        total += narticles(iLib);
+    if (total < 2 * FUZZY_TASK_WORDS)
+        nthreads = 1;
+
+    std::vector<FuzzyTask> tasks;
     for (size_t iLib = 0; iLib < oLib.size(); ++iLib) {
         if (progress_func)
             progress_func();
 
         //if (stardict_strcmp(sWord, poGetWord(0,iLib))>=0 && stardict_strcmp(sWord, poGetWord(narticles(iLib)-1,iLib))<=0) {
         //there are Chinese dicts and English dicts...
+        const bool trie = oLib[iLib]->lower_sorted(ctx.cursor(iLib));
+        const int32_t iwords = narticles(iLib);
+        // a few ranges per thread, so that the threads done first take over the rest.
+        int32_t parts = nthreads > 1 ? std::min<int32_t>(iwords / FUZZY_TASK_WORDS, nthreads * 4) : 1;
+        if (parts < 1)
+            parts = 1;
+        for (int32_t i = 0; i < parts; ++i)
+            tasks.push_back({iLib, int32_t(int64_t(iwords) * i / parts), int32_t(int64_t(iwords) * (i + 1) / parts), trie});
+    }
 
-        const int iwords = narticles(iLib);
-        for (int index = 0; index < iwords; index++) {
-            sCheck = poGetWord(index, iLib);
+    auto scan = [&](const FuzzyTask &task, IndexCursor &cur, FuzzyList &list) {
+        if (task.trie) {
+            FuzzyTrieWalker oTrieWalker(ucs4_str2);
+            oTrieWalker.walk(*oLib[task.iLib], cur, task.lo, task.hi, list.max_distance(),
+                             [&list](const char *sCheck, int iDistance) { list.consider(sCheck, iDistance); });
+            return;
+        }
+        std::string lower_check;
+        for (int32_t index = task.lo; index < task.hi; index++) {
+            const char *sCheck = oLib[task.iLib]->get_key(index, cur);
             // tolower and skip too long or too short words
-            iCheckWordLen = strlen(sCheck);
-            if (iCheckWordLen - ucs4_str2_len >= iMaxDistance || ucs4_str2_len - iCheckWordLen >= iMaxDistance)
+            const int32_t iCheckWordLen = strlen(sCheck);
+            if (!list.near_length(iCheckWordLen))
                 continue;
-#if 0
-            ucs4_str1 = g_utf8_to_ucs4_fast(sCheck, -1, nullptr);
-            if (iCheckWordLen > ucs4_str2_len)
-                ucs4_str1[ucs4_str2_len] = 0;
-            unicode_strdown(ucs4_str1);
-#else
-            // only do english...
-            ucs4_str1 = g_utf8_strdown(sCheck);
-            if (iCheckWordLen > ucs4_str2_len)
-                ucs4_str1[ucs4_str2_len] = 0;
-#endif
-            iDistance = oEditDistance.CalEditDistance(ucs4_str1, ucs4_str2, iMaxDistance);
-            free(ucs4_str1);
-            if (iDistance < iMaxDistance && iDistance < ucs4_str2_len) {
-                // when ucs4_str2_len=1,2 we need less fuzzy.
-                Found = true;
-                bool bAlreadyInList = false;
-                int iMaxDistanceAt = 0;
-                for (int j = 0; j < reslist_size; j++) {
-                    if (oFuzzystruct[j].pMatchWord && strcmp(oFuzzystruct[j].pMatchWord, sCheck) == 0) { //already in list
-                        bAlreadyInList = true;
-                        break;
-                    }
-                    //find the position,it will certainly be found (include the first time) as iMaxDistance is set by last time.
-                    if (oFuzzystruct[j].iMatchWordDistance == iMaxDistance) {
-                        iMaxDistanceAt = j;
-                    }
-                }
-                if (!bAlreadyInList) {
-                    if (oFuzzystruct[iMaxDistanceAt].pMatchWord)
-                        free(oFuzzystruct[iMaxDistanceAt].pMatchWord);
-                    oFuzzystruct[iMaxDistanceAt].pMatchWord = strdup(sCheck);
-                    oFuzzystruct[iMaxDistanceAt].iMatchWordDistance = iDistance;
-                    // calc new iMaxDistance
-                    iMaxDistance = iDistance;
-                    for (int j = 0; j < reslist_size; j++) {
-                        if (oFuzzystruct[j].iMatchWordDistance > iMaxDistance)
-                            iMaxDistance = oFuzzystruct[j].iMatchWordDistance;
-                    } // calc new iMaxDistance
-                } // add to list
-            } // find one
+            // only do english... compare the lower case head as long as the query.
+            lower_check.assign(sCheck, std::min(iCheckWordLen, ucs4_str2_len));
+            for (auto &c : lower_check)
+                c = tolower(c);
+            list.consider(sCheck, oEditDistance.CalEditDistance(lower_check.data(), lower_check.size(), list.max_distance()));
         } // each word
+    };
 
-    } // each lib
-    free(ucs4_str2);
-
-    if (Found) // sort with distance
-        std::sort(oFuzzystruct.begin(), oFuzzystruct.end(), [](const Fuzzystruct &lh, const Fuzzystruct &rh) -> bool {
-            if (lh.iMatchWordDistance != rh.iMatchWordDistance)
-                return lh.iMatchWordDistance < rh.iMatchWordDistance;
-
-            if (lh.pMatchWord && rh.pMatchWord)
-                return stardict_strcmp(lh.pMatchWord, rh.pMatchWord) < 0;
-
-            return false;
+    FuzzyList result(reslist_size, iMaxFuzzyDistance, ucs4_str2_len);
+    if (tasks.size() < 2 || nthreads < 2) {
+        for (const FuzzyTask &task : tasks)
+            scan(task, ctx.cursor(task.iLib), result);
+    } else {
+        // Each task keeps its own list, which never drops a word the one
+        // list of a serial scan would take: its farthest word can only be
+        // farther. The words a task took are then replayed in task order
+        // through the same checks, giving the very list of the serial scan.
+        struct TaskResult {
+            std::vector<FuzzyCandidate> taken;
+            unsigned long page_hits = 0, page_misses = 0;
+        };
+        std::vector<TaskResult> results(tasks.size());
+        fuzzy_pool_->run(tasks.size(), [&](size_t i) {
+            IndexCursor cur;
+            FuzzyList list(reslist_size, iMaxFuzzyDistance, ucs4_str2_len, &results[i].taken);
+            scan(tasks[i], cur, list);
+            results[i].page_hits = cur.page_hits;
+            results[i].page_misses = cur.page_misses;
         });
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            for (const FuzzyCandidate &c : results[i].taken) {
+                if (result.near_length(c.word.size()))
+                    result.consider(c.word.c_str(), c.distance);
+            }
+            ctx.cursor(tasks[i].iLib).page_hits += results[i].page_hits;
+            ctx.cursor(tasks[i].iLib).page_misses += results[i].page_misses;
+        }
+    }
+    free(ucs4_str2);
 
-    for (int i = 0; i < reslist_size; ++i)
-        reslist[i] = oFuzzystruct[i].pMatchWord;
-
-    return Found;
-#else
-    return false;
-#endif
+    result.release(reslist);
+    return result.found();
 }
 
-int Libs::LookupWithRule(const char *word, char **ppMatchWord)
+int Libs::LookupWithRule(const char *word, char **ppMatchWord, QueryContext &ctx) const
 {
     int32_t aiIndex[MAX_MATCH_ITEM_PER_LIB + 1];
     int iMatchCount = 0;
 
-    try {
-        std::regex spec(word, std::regex::egrep | std::regex::icase | std::regex::nosubs);
-        for (std::vector<Dict *>::size_type iLib = 0; iLib < oLib.size(); iLib++) {
-
-            if (oLib[iLib]->LookupWithRule(spec, aiIndex, MAX_MATCH_ITEM_PER_LIB + 1)) {
-                if (progress_func)
-                    progress_func();
-                for (int i = 0; aiIndex[i] != -1; i++) {
-                    const char *sMatchWord = poGetWord(aiIndex[i], iLib);
-                    bool bAlreadyInList = false;
-                    for (int j = 0; j < iMatchCount; j++) {
-                        if (strcmp(ppMatchWord[j], sMatchWord) == 0) { //already in list
-                            bAlreadyInList = true;
-                            break;
-                        }
+    const GlobPattern spec(word);
+    for (std::vector<Dict *>::size_type iLib = 0; iLib < oLib.size(); iLib++) {
+
+        if (oLib[iLib]->LookupWithRule(spec, aiIndex, MAX_MATCH_ITEM_PER_LIB + 1, ctx.cursor(iLib))) {
+            if (progress_func)
+                progress_func();
+            for (int i = 0; aiIndex[i] != -1; i++) {
+                const char *sMatchWord = poGetWord(aiIndex[i], iLib, ctx);
+                bool bAlreadyInList = false;
+                for (int j = 0; j < iMatchCount; j++) {
+                    if (strcmp(ppMatchWord[j], sMatchWord) == 0) { //already in list
+                        bAlreadyInList = true;
+                        break;
                     }
-                    if (!bAlreadyInList)
-                        ppMatchWord[iMatchCount++] = strdup(sMatchWord);
                 }
+                if (!bAlreadyInList)
+                    ppMatchWord[iMatchCount++] = strdup(sMatchWord);
             }
         }
-        //g_pattern_spec_free(pspec);
-    } catch (const std::regex_error &) {
-        printf("Regex error:%s\n", word);
-        return 0;
     }
 
     if (iMatchCount) // sort it.
@@ -1364,7 +1638,7 @@ int Libs::LookupWithRule(const char *word, char **ppMatchWord)
 
     return iMatchCount;
 }
-bool Libs::LookupData(const char *sWord, std::vector<char *> *reslist)
+bool Libs::LookupData(const char *sWord, std::vector<char *> *reslist, QueryContext &ctx) const
 {
     std::vector<std::string> SearchWords;
     std::string SearchWord;
@@ -1405,25 +1679,34 @@ bool Libs::LookupData(const char *sWord, std::vector<char *> *reslist)
     if (SearchWords.empty())
         return false;
 
+    TermMatcher terms(SearchWords);
     uint32_t max_size = 0;
     char *origin_data = nullptr;
+    std::vector<uint32_t> candidates;
     for (std::vector<Dict *>::size_type i = 0; i < oLib.size(); ++i) {
         if (!oLib[i]->containSearchData())
             continue;
         if (progress_func)
             progress_func();
-        const int iwords = narticles(i);
-        const char *key;
-        uint32_t offset, size;
-        for (int j = 0; j < iwords; ++j) {
-            oLib[i]->get_key_and_data(j, &key, &offset, &size);
-            if (size > max_size) {
-                origin_data = (char *)realloc(origin_data, size);
-                max_size = size;
+        // with a token index only the entries holding all the words are read.
+        if (oLib[i]->data_candidates(SearchWords, candidates)) {
+            const char *key;
+            uint32_t offset, size;
+            for (const uint32_t j : candidates) {
+                oLib[i]->get_key_and_data(j, &key, &offset, &size, ctx.cursor(i));
+                if (size > max_size) {
+                    origin_data = (char *)realloc(origin_data, size);
+                    max_size = size;
+                }
+                if (oLib[i]->SearchData(terms, offset, size, origin_data, ctx))
+                    reslist[i].push_back(strdup(key));
             }
-            if (oLib[i]->SearchData(SearchWords, offset, size, origin_data))
-                reslist[i].push_back(strdup(key));
+            continue;
         }
+        // otherwise every entry is read, in the order of the data.
+        oLib[i]->ScanData(terms, candidates, ctx.cursor(i), ctx.dzctx);
+        for (const uint32_t j : candidates)
+            reslist[i].push_back(strdup(poGetWord(j, i, ctx)));
     }
     free(origin_data);
 
@@ -1503,8 +1786,11 @@ query_t analyze_query(const char *s, std::string &res)
         if (*p == '*' || *p == '?')
             regexp = true;
     }
-    if (regexp)
+    if (regexp) {
+        // the pattern keeps its escapes, GlobPattern tells \* from *.
+        res = s;
         return qtREGEXP;
+    }
 
     return qtSIMPLE;
 }
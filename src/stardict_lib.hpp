@@ -6,15 +6,22 @@
 #include <list>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
-#include <regex>
+#include <unistd.h>
 
 #include "dictziplib.hpp"
+#include "glob.hpp"
+#include "lrucache.hpp"
+#include "mapfile.hpp"
+#include "term_matcher.hpp"
+#include "token_index.hpp"
 #include "utils.hpp"
 
 const int MAX_MATCH_ITEM_PER_LIB = 100;
 const int MAX_FUZZY_DISTANCE = 3; // at most MAX_FUZZY_DISTANCE-1 differences allowed when find similar words
+const int32_t FUZZY_TASK_WORDS = 32768; // fewest index entries a fuzzy lookup gives to one more thread
 
 inline uint32_t get_uint32(const char *addr)
 {
@@ -28,16 +35,77 @@ inline void set_uint32(char *addr, uint32_t val)
     memcpy(addr, &val, sizeof(uint32_t));
 }
 
-struct cacheItem {
-    uint32_t offset = 0;
-    char *data = nullptr;
-    //write code here to make it inline
-    cacheItem() {}
-    ~cacheItem() { free(data); }
+class DictBase;
+
+// The fields of an entry, each after its type char as in a .dict without
+// sametypesequence. They point into the mapped .dict, or into data for the
+// entries that had to be read or decoded.
+struct WordData {
+    const char *fields = nullptr;
+    uint32_t size = 0;
+    std::shared_ptr<const std::string> data;
+    explicit operator bool() const { return fields != nullptr; }
+};
+struct WordDataKey {
+    const DictBase *dict;
+    uint32_t offset;
+    bool operator==(const WordDataKey &o) const { return dict == o.dict && offset == o.offset; }
 };
+struct WordDataKeyHash {
+    size_t operator()(const WordDataKey &k) const
+    {
+        return std::hash<const void *>()(k.dict) * 31 + k.offset;
+    }
+};
+// decoded entries of all the dictionaries, by dictionary and offset.
+using WordDataCache = LruCache<WordDataKey, std::string, WordDataKeyHash>;
 
-const int WORDDATA_CACHE_NUM = 10;
 const int INVALID_INDEX = -100;
+const int INDEX_ENTR_PER_PAGE = 32;
+
+// Per-query scratch state of one index file: the entries of the page
+// parsed last and the data location of the last key returned.
+struct IndexCursor {
+    uint32_t wordentry_offset = 0;
+    uint32_t wordentry_size = 0;
+
+    struct page_entry {
+        const char *keystr;
+        uint32_t off, size;
+    };
+    int32_t page_idx = -1;
+    page_entry entries[INDEX_ENTR_PER_PAGE];
+    unsigned long page_hits = 0;
+    unsigned long page_misses = 0;
+};
+
+// Everything a lookup writes to. Dictionaries are shared read-only between
+// threads, each query brings its own context.
+class QueryContext
+{
+public:
+    // words and chunks may be nullptr, for no cache.
+    QueryContext(int ndicts, WordDataCache *words, DictChunkCache *chunks)
+        : dzctx(chunks)
+        , word_cache(words)
+        , cursors(ndicts)
+    {
+    }
+    // adds the cache counters of the query to the process metrics.
+    ~QueryContext();
+    QueryContext(const QueryContext &) = delete;
+    QueryContext &operator=(const QueryContext &) = delete;
+
+    IndexCursor &cursor(int iLib) { return cursors[iLib]; }
+
+    DictReadContext dzctx;
+    WordDataCache *const word_cache;
+    unsigned long cache_hits = 0;
+    unsigned long cache_misses = 0;
+
+private:
+    std::vector<IndexCursor> cursors;
+};
 
 class DictBase
 {
@@ -45,52 +113,58 @@ public:
     DictBase() {}
     DictBase(const DictBase &) = delete;
     DictBase &operator=(const DictBase &) = delete;
-    char *GetWordData(uint32_t idxitem_offset, uint32_t idxitem_size);
+    WordData GetWordData(uint32_t idxitem_offset, uint32_t idxitem_size, QueryContext &ctx) const;
     bool containSearchData() const
     {
         if (sametypesequence.empty())
             return true;
         return sametypesequence.find_first_of("mlgxty") != std::string::npos;
     }
-    bool SearchData(std::vector<std::string> &SearchWords, uint32_t idxitem_offset, uint32_t idxitem_size, char *origin_data);
+    bool SearchData(TermMatcher &SearchWords, uint32_t idxitem_offset, uint32_t idxitem_size, char *origin_data, QueryContext &ctx) const;
 
 protected:
-    ~DictBase()
-    {
-        if (dictfile)
-            fclose(dictfile);
-    }
+    ~DictBase() {}
+    // whether the fields of the entry [data, data + size) SearchData looks in hold all of SearchWords.
+    bool holds_all(TermMatcher &SearchWords, const char *data, uint32_t size) const;
     std::string sametypesequence;
-    FILE *dictfile = nullptr;
+    // a plain .dict is mapped, dictdata is nullptr for a .dict.dz.
+    MapFile dictfile;
+    const char *dictdata = nullptr;
+    unsigned long dictsize = 0;
     std::unique_ptr<DictData> dictdzfile;
 
+    // the entry in the mapped .dict, throws when it is past the end.
+    const char *map_data(uint32_t idxitem_offset, uint32_t idxitem_size) const;
+
 private:
-    cacheItem cache[WORDDATA_CACHE_NUM];
-    int cache_cur = 0;
+    void read_data(char *buffer, uint32_t idxitem_offset, uint32_t idxitem_size, QueryContext &ctx) const;
 };
 
 class IIndexFile
 {
 public:
-    uint32_t wordentry_offset;
-    uint32_t wordentry_size;
-
     virtual ~IIndexFile() {}
-    virtual bool load(const std::string &url, uint32_t wc, uint32_t fsize, bool verbose) = 0;
-    virtual const char *get_key(int32_t idx) = 0;
-    virtual void get_data(int32_t idx) = 0;
-    virtual const char *get_key_and_data(int32_t idx) = 0;
-    virtual bool lookup(const char *str, int32_t &idx, std::function<int(const char*,const char*)> cmp) = 0;
+    // what the user is told is appended to log, nothing when it is nullptr.
+    virtual bool load(const std::string &url, uint32_t wc, uint32_t fsize, std::string *log) = 0;
+    virtual const char *get_key(int32_t idx, IndexCursor &cur) const = 0;
+    virtual void get_data(int32_t idx, IndexCursor &cur) const = 0;
+    virtual const char *get_key_and_data(int32_t idx, IndexCursor &cur) const = 0;
+    virtual bool lookup(const char *str, int32_t &idx, std::function<int(const char*,const char*)> cmp, IndexCursor &cur) const = 0;
 };
 
+// The .syn stays mapped and is searched in place, through the offsets of
+// its entries in byte order of their keys.
 class SynFile
 {
 public:
     bool load(const std::string &url, uint32_t wc);
-    bool lookup(const char *str, int32_t &idx);
+    bool lookup(const char *str, int32_t &idx) const;
 
 private:
-    std::map<std::string, uint32_t> synonyms;
+    MapFile synmap;
+    const char *syndata = nullptr;
+    // sorted by key, a key found more than once has its entries in file order.
+    std::vector<uint32_t> entries;
 };
 
 class Dict : public DictBase
@@ -99,26 +173,46 @@ public:
     Dict(): wordcount(0), syn_wordcount(0) {}
     Dict(const Dict &) = delete;
     Dict &operator=(const Dict &) = delete;
-    bool load(const std::string &ifofilename, bool verbose);
+    // the messages of the load go to log, see IIndexFile::load().
+    bool load(const std::string &ifofilename, std::string *log);
 
     uint32_t narticles() const { return wordcount; }
     const std::string &dict_name() const { return bookname; }
     const std::string &ifofilename() const { return ifo_file_name; }
 
-    const char *get_key(int32_t index) { return idx_file->get_key(index); }
-    char *get_data(int32_t index)
+    const char *get_key(int32_t index, IndexCursor &cur) const { return idx_file->get_key(index, cur); }
+    WordData get_data(int32_t index, IndexCursor &cur, QueryContext &ctx) const
     {
-        idx_file->get_data(index);
-        return DictBase::GetWordData(idx_file->wordentry_offset, idx_file->wordentry_size);
+        idx_file->get_data(index, cur);
+        return DictBase::GetWordData(cur.wordentry_offset, cur.wordentry_size, ctx);
     }
-    void get_key_and_data(int32_t index, const char **key, uint32_t *offset, uint32_t *size)
+    void get_key_and_data(int32_t index, const char **key, uint32_t *offset, uint32_t *size, IndexCursor &cur) const
     {
-        *key = idx_file->get_key_and_data(index);
-        *offset = idx_file->wordentry_offset;
-        *size = idx_file->wordentry_size;
+        *key = idx_file->get_key_and_data(index, cur);
+        *offset = cur.wordentry_offset;
+        *size = cur.wordentry_size;
+    }
+    bool Lookup(const char *str, int32_t &idx, bool ignorecase, IndexCursor &cur) const;
+    // only the keys starting with the literal prefix of spec are tried,
+    // when the keys are in lower-case order.
+    bool LookupWithRule(const GlobPattern &spec, int32_t *aIndex, int iBuffLen, IndexCursor &cur) const;
+    // Whether the keys are still in order once lower-cased, so that keys
+    // sharing a lower-case prefix sit next to each other. Checked on first use.
+    bool lower_sorted(IndexCursor &cur) const;
+    // Maps the inverted index of the definition words for |data searches,
+    // or builds and saves it first, reading every entry.
+    bool load_token_index(std::string *log);
+    // Puts in res, in index order, the entries SearchData would find
+    // SearchWords in, reading them all in the order of their data: each
+    // chunk of a .dict.dz is inflated at most once. The chunks already in
+    // the cache of dzctx are used, the cache is left as it is.
+    void ScanData(TermMatcher &SearchWords, std::vector<uint32_t> &res, IndexCursor &cur,
+                  DictReadContext &dzctx) const;
+    // see TokenIndex::candidates(), false without a token index.
+    bool data_candidates(const std::vector<std::string> &words, std::vector<uint32_t> &res) const
+    {
+        return token_index && token_index->candidates(words, res);
     }
-    bool Lookup(const char *str, int32_t &idx, bool ignorecase);
-    bool LookupWithRule(const std::regex &spec, int32_t *aIndex, int iBuffLen);
 
 private:
     std::string ifo_file_name;
@@ -128,6 +222,14 @@ private:
 
     std::unique_ptr<IIndexFile> idx_file;
     std::unique_ptr<SynFile> syn_file;
+    std::unique_ptr<TokenIndex> token_index;
+    mutable std::once_flag lower_sorted_once;
+    mutable bool is_lower_sorted = false;
+    mutable std::once_flag offset_order_once;
+    mutable std::vector<uint32_t> by_offset;
+
+    // the entries by data offset, empty when that is the index order. Made on first use.
+    const std::vector<uint32_t> &offset_order(IndexCursor &cur) const;
 
     bool load_ifofile(const std::string &ifofilename, uint32_t &idxfilesize);
 };
@@ -139,42 +241,49 @@ public:
         : param_(param)
         , progress_func(f)
     {
+        if (param.word_cache_size > 0)
+            word_cache_.reset(new WordDataCache(size_t(param.word_cache_size) << 20));
+        if (param.chunk_cache_size > 0)
+            chunk_cache_.reset(new DictChunkCache(size_t(param.chunk_cache_size) << 20));
+        fuzzy_pool_.reset(new TaskPool(param.fuzzy_threads > 0 ? param.fuzzy_threads : std::thread::hardware_concurrency()));
         iMaxFuzzyDistance = MAX_FUZZY_DISTANCE; //need to read from cfg.
     }
     Libs(const Libs &) = delete;
     Libs &operator=(const Libs &) = delete;
 
-    bool load_dict(const std::string &url);
     void load(const std::list<std::string> &dicts_dirs,
               const std::list<std::string> &order_list,
               const std::list<std::string> &disable_list);
     int32_t narticles(int idict) const { return oLib[idict]->narticles(); }
     const std::string &dict_name(int idict) const { return oLib[idict]->dict_name(); }
+    const std::string &ifofilename(int idict) const { return oLib[idict]->ifofilename(); }
     int ndicts() const { return oLib.size(); }
+    WordDataCache *word_cache() const { return word_cache_.get(); }
+    DictChunkCache *chunk_cache() const { return chunk_cache_.get(); }
 
-    const char *poGetWord(int32_t iIndex, int iLib)
+    const char *poGetWord(int32_t iIndex, int iLib, QueryContext &ctx) const
     {
-        return oLib[iLib]->get_key(iIndex);
+        return oLib[iLib]->get_key(iIndex, ctx.cursor(iLib));
     }
-    char *poGetWordData(int32_t iIndex, int iLib)
+    WordData poGetWordData(int32_t iIndex, int iLib, QueryContext &ctx) const
     {
         if (iIndex == INVALID_INDEX)
-            return nullptr;
-        return oLib[iLib]->get_data(iIndex);
+            return WordData();
+        return oLib[iLib]->get_data(iIndex, ctx.cursor(iLib), ctx);
     }
-    const char *poGetCurrentWord(int32_t *iCurrent);
-    const char *poGetNextWord(const char *word, int32_t *iCurrent);
-    const char *poGetPreWord(int32_t *iCurrent);
-    bool LookupWord(const char *sWord, int32_t &iWordIndex, int iLib)
+    const char *poGetCurrentWord(int32_t *iCurrent, QueryContext &ctx) const;
+    const char *poGetNextWord(const char *word, int32_t *iCurrent, QueryContext &ctx) const;
+    const char *poGetPreWord(int32_t *iCurrent, QueryContext &ctx) const;
+    bool LookupWord(const char *sWord, int32_t &iWordIndex, int iLib, QueryContext &ctx) const
     {
-        return oLib[iLib]->Lookup(sWord, iWordIndex, false);
+        return oLib[iLib]->Lookup(sWord, iWordIndex, false, ctx.cursor(iLib));
     }
-    bool SimpleLookupWord(const char *sWord, int32_t &iWordIndex, int iLib);
+    bool SimpleLookupWord(const char *sWord, int32_t &iWordIndex, int iLib, QueryContext &ctx) const;
 
-    bool LookupSimilarWord(const char *sWord, int32_t &iWordIndex, int iLib);
-    bool LookupWithFuzzy(const char *sWord, char *reslist[], int reslist_size);
-    int LookupWithRule(const char *sWord, char *reslist[]);
-    bool LookupData(const char *sWord, std::vector<char *> *reslist);
+    bool LookupSimilarWord(const char *sWord, int32_t &iWordIndex, int iLib, QueryContext &ctx) const;
+    bool LookupWithFuzzy(const char *sWord, char *reslist[], int reslist_size, QueryContext &ctx) const;
+    int LookupWithRule(const char *sWord, char *reslist[], QueryContext &ctx) const;
+    bool LookupData(const char *sWord, std::vector<char *> *reslist, QueryContext &ctx) const;
 
 protected:
     ~Libs();
@@ -184,6 +293,10 @@ private:
     std::vector<Dict *> oLib; // word Libs.
     int iMaxFuzzyDistance;
     std::function<void(void)> progress_func;
+    std::unique_ptr<WordDataCache> word_cache_;
+    std::unique_ptr<DictChunkCache> chunk_cache_;
+    // the threads every fuzzy lookup scans the indexes with, its own included.
+    std::unique_ptr<TaskPool> fuzzy_pool_;
 };
 
 enum query_t {
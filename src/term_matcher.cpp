@@ -0,0 +1,96 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "term_matcher.hpp"
+
+TermMatcher::TermMatcher(const std::vector<std::string> &words, size_t max_simd_terms)
+{
+    for (const auto &w : words)
+        if (!w.empty() && std::find(terms.begin(), terms.end(), w) == terms.end())
+            terms.push_back(w);
+    use_automaton = terms.size() > max_simd_terms;
+    if (use_automaton) {
+        for (const auto &t : terms)
+            automaton.add(t);
+        automaton.build();
+    }
+    for (const auto &t : terms)
+        splats += std::string(16, t[0]) + std::string(16, t.back());
+    tail.resize(terms.size());
+    found.resize(terms.size());
+    reset();
+}
+
+bool TermMatcher::find_automaton(const char *p, size_t len)
+{
+    int state = AhoCorasick::start();
+    for (const char *e = p + len; p != e; ++p) {
+        state = automaton.next(state, *p);
+        for (int id = automaton.match(state); id >= 0; id = automaton.shorter(id)) {
+            mark(id);
+            if (nleft == 0)
+                return true;
+        }
+    }
+    return false;
+}
+
+bool TermMatcher::find_each(const char *p, size_t len)
+{
+    const size_t nterms = terms.size();
+    std::fill(tail.begin(), tail.end(), 0);
+#ifdef __SSE2__
+    todo.clear();
+    for (size_t j = 0; j < nterms; ++j)
+        if (!found[j])
+            todo.push_back(j);
+    // the 16 places from i, for each word that has all of them in the text.
+    for (size_t i = 0; i + 16 <= len && !todo.empty(); i += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        for (size_t k = 0; k < todo.size();) {
+            const size_t j = todo[k];
+            const std::string &t = terms[j];
+            const size_t n = t.size();
+            if (i + 15 + n > len) {
+                todo[k] = todo.back();
+                todo.pop_back();
+                continue;
+            }
+            const __m128i *splat = reinterpret_cast<const __m128i *>(splats.data() + 32 * j);
+            const __m128i last = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i + n - 1));
+            unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block, _mm_loadu_si128(splat)),
+                                                            _mm_cmpeq_epi8(last, _mm_loadu_si128(splat + 1))));
+            // the first and the last byte are right, n < 3 is a match.
+            for (; mask; mask &= mask - 1)
+                if (n < 3 || memcmp(p + i + __builtin_ctz(mask) + 1, t.data() + 1, n - 2) == 0)
+                    break;
+            if (mask) {
+                mark(j);
+                if (nleft == 0)
+                    return true;
+                todo[k] = todo.back();
+                todo.pop_back();
+                continue;
+            }
+            tail[j] = i + 16;
+            ++k;
+        }
+    }
+#endif
+    // the places left near the end.
+    for (size_t j = 0; j < nterms; ++j) {
+        if (!found[j] && memmem(p + tail[j], len - tail[j], terms[j].data(), terms[j].size())) {
+            mark(j);
+            if (nleft == 0)
+                return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "aho_corasick.hpp"
+
+// The words of a |data search, looked for in the texts of one entry after
+// the other. Each text is read once whatever the number of words: up to
+// max_simd_terms of them are tested 16 places at a time with SSE2, only
+// the places where both the first and the last byte of a word are right
+// being compared, more go through an Aho-Corasick automaton. While at most
+// MEMMEM_TERMS words are left to find, memmem looks for each of them
+// instead, it is faster than the byte filter for one or two words.
+// The words found so far are kept in the matcher, one query uses it at a
+// time.
+class TermMatcher
+{
+public:
+    static const size_t SIMD_TERMS = 16;
+    static const size_t MEMMEM_TERMS = 2;
+
+    explicit TermMatcher(const std::vector<std::string> &terms, size_t max_simd_terms = SIMD_TERMS);
+
+    // forgets the words found, for the texts of another entry.
+    void reset()
+    {
+        std::fill(found.begin(), found.end(), false);
+        nleft = terms.size();
+    }
+    // Looks for the words not found yet in [p, p + len), stopping as soon
+    // as all are found. Whether they all are.
+    bool find(const char *p, size_t len)
+    {
+        if (nleft == 0)
+            return true;
+        if (use_automaton)
+            return find_automaton(p, len);
+        return nleft > MEMMEM_TERMS ? find_each(p, len) : find_memmem(p, len);
+    }
+
+private:
+    bool find_each(const char *p, size_t len);
+    bool find_memmem(const char *p, size_t len)
+    {
+        for (size_t j = 0; j < terms.size(); ++j) {
+            if (!found[j] && memmem(p, len, terms[j].data(), terms[j].size())) {
+                mark(j);
+                if (nleft == 0)
+                    return true;
+            }
+        }
+        return false;
+    }
+    bool find_automaton(const char *p, size_t len);
+    void mark(size_t term)
+    {
+        if (!found[term]) {
+            found[term] = true;
+            --nleft;
+        }
+    }
+
+    std::vector<std::string> terms; // distinct and not empty
+    std::vector<char> found;
+    size_t nleft = 0;
+    // of find_each: 16 times the first byte then 16 times the last one of
+    // each word, the words not found yet in the text, where memmem goes on
+    // for each word.
+    std::string splats;
+    std::vector<size_t> todo, tail;
+    bool use_automaton;
+    AhoCorasick automaton; // with terms as patterns 0, 1, ...
+};
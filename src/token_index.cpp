@@ -0,0 +1,171 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+
+#include <sys/stat.h>
+
+#include "token_index.hpp"
+
+namespace
+{
+const char TOKEN_INDEX_MAGIC[16] = "sdwv tokens 0.1";
+
+struct TokenIndexHeader {
+    char magic[16];
+    uint32_t wordcount;
+    uint32_t ntokens;
+    uint32_t npostings;
+    uint32_t blob_size;
+};
+
+inline bool token_byte(char c)
+{
+    const unsigned char u = c;
+    return u >= 0x80 || (u >= '0' && u <= '9') || (u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z');
+}
+
+// calls f(b, e) for each word of [p, end).
+template <typename F>
+void for_each_token(const char *p, const char *end, F f)
+{
+    while (p != end) {
+        while (p != end && !token_byte(*p))
+            ++p;
+        const char *b = p;
+        while (p != end && token_byte(*p))
+            ++p;
+        if (b != p)
+            f(b, p);
+    }
+}
+}
+
+bool TokenIndex::load(const std::string &file, uint32_t nwords, time_t newest)
+{
+    struct stat st;
+    if (stat(file.c_str(), &st) != 0 || st.st_mtime < newest || size_t(st.st_size) < sizeof(TokenIndexHeader))
+        return false;
+    if (!map.open(file.c_str(), st.st_size))
+        return false;
+    TokenIndexHeader h;
+    memcpy(&h, map.begin(), sizeof(h));
+    if (memcmp(h.magic, TOKEN_INDEX_MAGIC, sizeof(h.magic)) != 0 || h.wordcount != nwords)
+        return false;
+    const uint64_t size = sizeof(h) + (2 * (uint64_t(h.ntokens) + 1) + h.npostings) * sizeof(uint32_t) + h.blob_size;
+    if (size != uint64_t(st.st_size))
+        return false;
+    wordcount = h.wordcount;
+    ntokens = h.ntokens;
+    token_offsets = reinterpret_cast<const uint32_t *>(map.begin() + sizeof(h));
+    posting_offsets = token_offsets + ntokens + 1;
+    postings = posting_offsets + ntokens + 1;
+    blob = reinterpret_cast<const char *>(postings + h.npostings);
+    blob_size = h.blob_size;
+    return true;
+}
+
+bool TokenIndex::candidates(const std::vector<std::string> &words, std::vector<uint32_t> &res) const
+{
+    const size_t most = wordcount / MAX_SHARE;
+    bool narrowed = false;
+    std::vector<uint32_t> entries, both;
+    for (const std::string &word : words) {
+        // a run of word bytes of the text looked for lies within a word of the entry.
+        bool empty = false;
+        for_each_token(word.data(), word.data() + word.size(), [&](const char *b, const char *e) {
+            if (empty)
+                return;
+            entries.clear();
+            // the postings are made distinct whenever they pass next_check,
+            // a run in more than most entries is left out, see MAX_SHARE.
+            size_t next_check = most;
+            const char *p = blob, *const end = blob + blob_size;
+            for (const char *hit; (hit = static_cast<const char *>(memmem(p, end - p, b, e - b)));) {
+                const uint32_t t = std::upper_bound(token_offsets, token_offsets + ntokens + 1, uint32_t(hit - blob)) - token_offsets - 1;
+                entries.insert(entries.end(), postings + posting_offsets[t], postings + posting_offsets[t + 1]);
+                p = blob + token_offsets[t + 1];
+                if (entries.size() > next_check) {
+                    std::sort(entries.begin(), entries.end());
+                    entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+                    if (entries.size() > most)
+                        return;
+                    next_check = std::max(most, 2 * entries.size());
+                }
+            }
+            std::sort(entries.begin(), entries.end());
+            entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+            if (entries.size() > most)
+                return;
+            if (!narrowed) {
+                res.swap(entries);
+                narrowed = true;
+            } else {
+                both.clear();
+                std::set_intersection(res.begin(), res.end(), entries.begin(), entries.end(), std::back_inserter(both));
+                res.swap(both);
+            }
+            empty = res.empty();
+        });
+        if (empty)
+            break;
+    }
+    return narrowed;
+}
+
+void TokenIndex::Builder::add(uint32_t entry, const char *text, size_t len)
+{
+    for_each_token(text, text + len, [&](const char *b, const char *e) {
+        std::vector<uint32_t> &list = postings[std::string(b, e)];
+        if (list.empty() || list.back() != entry)
+            list.push_back(entry);
+    });
+}
+
+bool TokenIndex::Builder::save(const std::string &file, uint32_t wordcount) const
+{
+    std::vector<const std::pair<const std::string, std::vector<uint32_t>> *> tokens;
+    tokens.reserve(postings.size());
+    for (const auto &p : postings)
+        tokens.push_back(&p);
+    std::sort(tokens.begin(), tokens.end(), [](decltype(tokens[0]) a, decltype(tokens[0]) b) { return a->first < b->first; });
+
+    TokenIndexHeader h;
+    memcpy(h.magic, TOKEN_INDEX_MAGIC, sizeof(h.magic));
+    h.wordcount = wordcount;
+    h.ntokens = tokens.size();
+    std::vector<uint32_t> token_offsets, posting_offsets;
+    token_offsets.reserve(tokens.size() + 1);
+    posting_offsets.reserve(tokens.size() + 1);
+    uint32_t blob_size = 0, npostings = 0;
+    for (const auto *t : tokens) {
+        token_offsets.push_back(blob_size);
+        posting_offsets.push_back(npostings);
+        blob_size += t->first.size() + 1;
+        npostings += t->second.size();
+    }
+    token_offsets.push_back(blob_size);
+    posting_offsets.push_back(npostings);
+    h.npostings = npostings;
+    h.blob_size = blob_size;
+
+    FILE *out = fopen(file.c_str(), "wb");
+    if (!out)
+        return false;
+    bool ok = fwrite(&h, sizeof(h), 1, out) == 1 &&
+              fwrite(token_offsets.data(), sizeof(uint32_t), token_offsets.size(), out) == token_offsets.size() &&
+              fwrite(posting_offsets.data(), sizeof(uint32_t), posting_offsets.size(), out) == posting_offsets.size();
+    for (size_t i = 0; ok && i < tokens.size(); ++i)
+        ok = fwrite(tokens[i]->second.data(), sizeof(uint32_t), tokens[i]->second.size(), out) == tokens[i]->second.size();
+    for (size_t i = 0; ok && i < tokens.size(); ++i)
+        ok = fwrite(tokens[i]->first.c_str(), 1, tokens[i]->first.size() + 1, out) == tokens[i]->first.size() + 1;
+    if (fclose(out) != 0 || !ok) {
+        remove(file.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mapfile.hpp"
+
+// Inverted index of the words in the definitions of a dictionary, for
+// |data searches. A word is a run of bytes other than ASCII spaces,
+// punctuation and control characters. Each word maps to the entries
+// holding it, in index order. The index is built once, saved next to the
+// .oft cache and mapped from there.
+class TokenIndex
+{
+public:
+    // maps file if it was made for wordcount entries, not before newest.
+    bool load(const std::string &file, uint32_t wordcount, time_t newest);
+
+    // The entries, in order, that can hold every one of words as
+    // SearchData looks for them. A run of word bytes found in more than
+    // 1 / MAX_SHARE of the entries does not narrow them, reading its
+    // postings would cost more than the scan. false when no run narrows
+    // the entries, any entry can then hold them.
+    bool candidates(const std::vector<std::string> &words, std::vector<uint32_t> &res) const;
+
+    static const uint32_t MAX_SHARE = 4;
+
+    class Builder
+    {
+    public:
+        // the text of a field of entry, entries come in index order.
+        void add(uint32_t entry, const char *text, size_t len);
+        bool save(const std::string &file, uint32_t wordcount) const;
+
+    private:
+        std::unordered_map<std::string, std::vector<uint32_t>> postings;
+    };
+
+private:
+    MapFile map;
+    uint32_t wordcount = 0;
+    uint32_t ntokens = 0;
+    const uint32_t *token_offsets = nullptr; // ntokens + 1 into blob
+    const uint32_t *posting_offsets = nullptr; // ntokens + 1 into postings
+    const uint32_t *postings = nullptr;
+    const char *blob = nullptr; // the words, each followed by a '\0'
+    uint32_t blob_size = 0;
+};
@@ -28,8 +28,6 @@
 #include <cstring>
 #include <dirent.h>
 #include <sys/stat.h>
-#include <iomanip>
-#include <sstream>
 #include <algorithm>
 
 #include "utils.hpp"
@@ -72,42 +70,41 @@ void for_each_file(const std::list<std::string> &dirs_list, const std::string &s
 }
 
 // based on https://stackoverflow.com/questions/7724448/simple-json-string-escape-for-c/33799784#33799784
-std::string json_escape_string(const std::string &s)
+void json_escape_string(const char *s, size_t len, std::string &out)
 {
-    std::ostringstream o;
-    for (auto c = s.cbegin(); c != s.cend(); c++) {
+    for (const char *c = s, *e = s + len; c != e; c++) {
         switch (*c) {
         case '"':
-            o << "\\\"";
+            out += "\\\"";
             break;
         case '\\':
-            o << "\\\\";
+            out += "\\\\";
             break;
         case '\b':
-            o << "\\b";
+            out += "\\b";
             break;
         case '\f':
-            o << "\\f";
+            out += "\\f";
             break;
         case '\n':
-            o << "\\n";
+            out += "\\n";
             break;
         case '\r':
-            o << "\\r";
+            out += "\\r";
             break;
         case '\t':
-            o << "\\t";
+            out += "\\t";
             break;
         default:
             if (static_cast<unsigned int>(*c) <= 0x1f) {
-                o << "\\u"
-                  << std::hex << std::setw(4) << std::setfill('0') << (int)*c;
+                char u[8];
+                snprintf(u, sizeof(u), "\\u%04x", *c);
+                out += u;
             } else {
-                o << *c;
+                out += *c;
             }
         }
     }
-    return o.str();
 }
 
 char *g_file_get_contents(const char *filename)
@@ -140,3 +137,109 @@ char *g_file_get_contents(const char *filename)
     content[res] = 0;
     return content;
 }
+
+void parallel_for(size_t n, unsigned nthreads, const std::function<void(size_t)> &f)
+{
+    if (nthreads == 0)
+        nthreads = 1;
+    if (nthreads > n)
+        nthreads = n;
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto work = [&]() {
+        for (size_t i; (i = next++) < n;) {
+            try {
+                f(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < nthreads; ++i)
+        workers.emplace_back(work);
+    work();
+    for (auto &t : workers)
+        t.join();
+    if (error)
+        std::rethrow_exception(error);
+}
+
+TaskPool::TaskPool(unsigned nthreads)
+{
+    for (unsigned i = 1; i < nthreads; ++i)
+        threads.emplace_back(&TaskPool::loop, this);
+}
+
+TaskPool::~TaskPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    more.notify_all();
+    for (auto &t : threads)
+        t.join();
+}
+
+void TaskPool::work(Job &job)
+{
+    for (size_t i; (i = job.next++) < job.n;) {
+        try {
+            (*job.f)(i);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!job.error)
+                job.error = std::current_exception();
+        }
+        if (++job.done == job.n) {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished.notify_all();
+        }
+    }
+}
+
+void TaskPool::loop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        more.wait(lock, [this] { return stop || !jobs.empty(); });
+        if (stop)
+            return;
+        const std::shared_ptr<Job> job = jobs.front();
+        if (job->next >= job->n) {
+            jobs.pop_front();
+            continue;
+        }
+        lock.unlock();
+        work(*job);
+        lock.lock();
+    }
+}
+
+void TaskPool::run(size_t n, const std::function<void(size_t)> &f)
+{
+    if (n == 0)
+        return;
+    const std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->n = n;
+    job->f = &f;
+    job->next = 0;
+    job->done = 0;
+    if (n > 1 && !threads.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(job);
+        }
+        more.notify_all();
+    }
+    work(*job);
+    std::unique_lock<std::mutex> lock(mutex);
+    jobs.remove(job);
+    finished.wait(lock, [&job] { return job->done == job->n; });
+    if (job->error)
+        std::rethrow_exception(job->error);
+}
@@ -1,8 +1,15 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <exception>
 #include <functional>
 #include <list>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 #include <cassert>
 
 #ifndef G_DIR_SEPARATOR
@@ -24,10 +31,58 @@ struct Param_config {
     const char *transformat = nullptr;
     bool daemonize = false;
     int listen_port = -1;
+    int threads = 0;//HTTP worker threads, 0 for one per CPU core.
+    bool event_loop = false;//epoll reactor with keep-alive instead of a thread per connection.
+    int cache_size = 64;//rendered page cache in MiB, 0 to disable.
+    int word_cache_size = 16;//decoded dictionary entry cache in MiB, 0 to disable.
+    int chunk_cache_size = 32;//decompressed .dict.dz chunk cache in MiB, 0 to disable.
+    bool load_report = false;//print how long each dictionary took to load.
+    int fuzzy_threads = 0;//threads all fuzzy lookups share to scan the indexes, 0 for one per CPU core.
+    bool token_index = false;//keep an inverted index of the definition words for |data searches.
 };
 
 extern void for_each_file(const std::list<std::string> &dirs_list, const std::string &suff,
                           const std::list<std::string> &order_list, const std::list<std::string> &disable_list,
                           const std::function<void(const std::string &, bool)> &f);
-extern std::string json_escape_string(const std::string &str);
+// Calls f(0) .. f(n - 1) on up to nthreads threads, the caller's included,
+// and returns when all are done. The first exception thrown is rethrown.
+extern void parallel_for(size_t n, unsigned nthreads, const std::function<void(size_t)> &f);
+
+// Threads started once and shared by every caller of run(). The caller
+// takes tasks of its own run() too, so a run goes on when all the threads
+// are busy with others, and the threads of the pool are all there are
+// whatever the number of runs at once.
+class TaskPool
+{
+public:
+    // nthreads counts the caller's, nthreads - 1 are started.
+    explicit TaskPool(unsigned nthreads);
+    TaskPool(const TaskPool &) = delete;
+    TaskPool &operator=(const TaskPool &) = delete;
+    ~TaskPool();
+
+    unsigned size() const { return threads.size() + 1; }
+    // Calls f(0) .. f(n - 1) and returns when all are done. The first
+    // exception thrown is rethrown.
+    void run(size_t n, const std::function<void(size_t)> &f);
+
+private:
+    struct Job {
+        size_t n;
+        const std::function<void(size_t)> *f;
+        std::atomic<size_t> next, done;
+        std::exception_ptr error;
+    };
+    // does tasks of job until there are none left to take.
+    void work(Job &job);
+    void loop();
+
+    std::mutex mutex;
+    std::condition_variable more, finished;
+    std::list<std::shared_ptr<Job>> jobs; // with tasks left to take
+    std::vector<std::thread> threads;
+    bool stop = false;
+};
+// appends the JSON string escape of s to out.
+extern void json_escape_string(const char *s, size_t len, std::string &out);
 extern char *g_file_get_contents(const char *filename);
@@ -0,0 +1,162 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstring>
+
+#include "xdxf.hpp"
+
+namespace
+{
+enum xdxf_action {
+    xaREPLACE,// write the replacement
+    xaKREF,// <kref>word</kref> as a link, or the replacement
+    xaRREF,// <rref>name.wav</rref> as a speaker sign, or an image
+};
+
+struct XdxfTag {
+    const char *tag;// literal text of the tag, or of its start
+    const char *html;
+    xdxf_action action;
+    size_t len;
+};
+
+// grouped by the byte after '<', no tag starts with another of its group.
+XdxfTag xdxf_tags[] = {
+    {"<k>", "<!--", xaREPLACE, 0},
+    {"<kref k=\"", "<a href=\"?w=", xaREPLACE, 0},
+    {"<kref>", "<kref>", xaKREF, 0},
+    {"<abr>", "<font color='green'>", xaREPLACE, 0},
+    {"<tr>", "<font color='brown'>", xaREPLACE, 0},
+    {"<ex>", "<font>", xaREPLACE, 0},
+    {"<c>", "<font>", xaREPLACE, 0},
+    {"<c c=", "<font color=", xaREPLACE, 0},
+    {"<rref>", "<img src=\"", xaRREF, 0},
+    {"</k>", "-->", xaREPLACE, 0},
+    {"</kref>", "</a>", xaREPLACE, 0},
+    {"</abr>", "</font>", xaREPLACE, 0},
+    {"</tr>", "</font>", xaREPLACE, 0},
+    {"</ex>", "</font>", xaREPLACE, 0},
+    {"</c>", "</font>", xaREPLACE, 0},
+    {"</rref>", "\">", xaREPLACE, 0},
+};
+const size_t NTAGS = sizeof(xdxf_tags) / sizeof(xdxf_tags[0]);
+
+// first entry for each byte after '<', NTAGS for none.
+struct XdxfIndex {
+    unsigned char first[256];
+    XdxfIndex()
+    {
+        memset(first, NTAGS, sizeof(first));
+        for (size_t i = NTAGS; i-- > 0;) {
+            xdxf_tags[i].len = strlen(xdxf_tags[i].tag);
+            first[static_cast<unsigned char>(xdxf_tags[i].tag[1])] = i;
+        }
+    }
+};
+const XdxfIndex xdxf_index;
+
+inline bool starts_with(const char *p, const char *e, const char *s, size_t len)
+{
+    return size_t(e - p) >= len && memcmp(p, s, len) == 0;
+}
+
+// The :x rules turn </k> into --> before they look for the links and the
+// sounds, so the text of those may hold it.
+const char close_k[] = "</k>";
+
+// the text of <kref>text</kref> when it has no other markup.
+bool kref_word(const char *p, const char *e, const char *&wend)
+{
+    static const char close[] = "</kref>";
+    for (wend = p; (wend = static_cast<const char *>(memchr(wend, '<', e - wend))); wend += sizeof(close_k) - 1) {
+        if (starts_with(wend, e, close, sizeof(close) - 1))
+            return true;
+        if (!starts_with(wend, e, close_k, sizeof(close_k) - 1))
+            return false;
+    }
+    return false;
+}
+
+// appends [p, e) with --> for each </k>.
+void append_kref_word(const char *p, const char *e, std::string &out)
+{
+    for (const char *lt; (lt = static_cast<const char *>(memchr(p, '<', e - p))); p = lt + sizeof(close_k) - 1) {
+        out.append(p, lt);
+        out += "-->";
+    }
+    out.append(p, e);
+}
+
+// whether <rref>name</rref> is a sound: name is "x.wav", x without '.', '<' and '/'.
+bool rref_sound(const char *p, const char *e, const char *&rend)
+{
+    static const char close[] = ".wav</rref>";
+    for (rend = p; rend != e && *rend != '.' && *rend != '/'; ++rend) {
+        if (*rend != '<')
+            continue;
+        if (!starts_with(rend, e, close_k, sizeof(close_k) - 1))
+            break;
+        rend += sizeof(close_k) - 2;
+    }
+    return starts_with(rend, e, close, sizeof(close) - 1);
+}
+}
+
+void xdxf_to_html(const char *b, const char *e, const std::string &dict_path, std::string &out)
+{
+    out.reserve(out.size() + (e - b) + (e - b) / 4);
+    const char *p = b;
+    while (p != e) {
+        const char *lt = static_cast<const char *>(memchr(p, '<', e - p));
+        if (!lt) {
+            out.append(p, e);
+            break;
+        }
+        out.append(p, lt);
+        p = lt;
+
+        const XdxfTag *tag = nullptr;
+        if (e - p > 1) {
+            for (size_t i = xdxf_index.first[static_cast<unsigned char>(p[1])]; i < NTAGS && xdxf_tags[i].tag[1] == p[1]; ++i) {
+                if (size_t(e - p) >= xdxf_tags[i].len && memcmp(p, xdxf_tags[i].tag, xdxf_tags[i].len) == 0) {
+                    tag = &xdxf_tags[i];
+                    break;
+                }
+            }
+        }
+        if (!tag) {
+            out += '<';
+            ++p;
+            continue;
+        }
+        p += tag->len;
+        const char *end;
+        switch (tag->action) {
+        case xaREPLACE:
+            out += tag->html;
+            break;
+        case xaKREF:
+            if (kref_word(p, e, end)) {
+                out += "<a href='?w=";
+                append_kref_word(p, end, out);
+                out += "'>";
+                append_kref_word(p, end, out);
+                out += "</a>";
+                p = end + strlen("</kref>");
+            } else
+                out += tag->html;
+            break;
+        case xaRREF:
+            if (rref_sound(p, e, end)) {
+                out += "&#128266";
+                p = end + strlen(".wav</rref>");
+            } else {
+                out += tag->html;
+                out += dict_path;
+                out += "/res/";
+            }
+            break;
+        }
+    }
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+
+// Converts the XDXF tags of [b, e) to HTML in one pass and appends the
+// result to out. The output is the one the :x rules of dist/format.conf
+// give without their /usr/share/stardict/dic= rule, which a format file
+// with ":x native" keeps as a rule after it. {{DICT_PATH}} is dict_path:
+//   <k> is commented out, <abr>, <tr>, <ex> and <c c="..."> become <font>,
+//   <kref> becomes a link to the word, <rref> an image, or a speaker sign
+//   for .wav files.
+// Other tags and the text are copied as they are.
+extern void xdxf_to_html(const char *b, const char *e, const std::string &dict_path, std::string &out);
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+// The unit tests say what failed, keep going and exit with the failures
+// counted, for ctest.
+namespace check
+{
+inline int &failures()
+{
+    static int n = 0;
+    return n;
+}
+
+inline int exit_code()
+{
+    if (failures())
+        printf("%d check(s) failed\n", failures());
+    return failures() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+}
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("%s:%d: failed: %s\n", __FILE__, __LINE__, #cond); \
+            ++check::failures(); \
+        } \
+    } while (0)
@@ -0,0 +1,148 @@
+/*
+ * GlobPattern against the std::regex the wildcard queries used to be
+ * translated to, on every pattern of a small alphabet over every word of
+ * another, then the cases the regex did not cover the same way: '?' over
+ * UTF-8 characters and the literal prefix.
+ */
+
+#include <cstring>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "glob.hpp"
+
+namespace
+{
+
+// the translation LookupWithRule used before GlobPattern had a matcher.
+std::regex glob_regex(const char *p)
+{
+    std::string res;
+    for (; *p; ++p) {
+        if (*p == '*' || *p == '?') {
+            res += *p == '*' ? ".*" : ".";
+            continue;
+        }
+        if (*p == '\\' && !*++p)
+            break;
+        if (strchr("\\^$.|+*?()[]{}", *p))
+            res += '\\';
+        res += *p;
+    }
+    return std::regex(res, std::regex::egrep | std::regex::icase | std::regex::nosubs);
+}
+
+// all the strings of up to len characters of alphabet.
+std::vector<std::string> all_strings(const char *alphabet, size_t len)
+{
+    std::vector<std::string> res(1);
+    for (size_t from = 0, to = 1; len > 0; --len, from = to, to = res.size())
+        for (size_t i = from; i < to; ++i)
+            for (const char *c = alphabet; *c; ++c)
+                res.push_back(res[i] + *c);
+    return res;
+}
+
+void check_like_regex()
+{
+    const std::vector<std::string> patterns = all_strings("aB*?\\.", 4);
+    const std::vector<std::string> words = all_strings("abAB.*?\\", 4);
+    for (const auto &pattern : patterns) {
+        const std::regex re = glob_regex(pattern.c_str());
+        const GlobPattern glob(pattern.c_str());
+        for (const auto &word : words) {
+            const bool want = std::regex_match(word, re);
+            if (glob.match(word.c_str()) != want) {
+                printf("'%s' on '%s' should be %d\n", pattern.c_str(), word.c_str(), want);
+                CHECK(false);
+            }
+        }
+    }
+}
+
+bool match(const char *pattern, const char *key)
+{
+    return GlobPattern(pattern).match(key);
+}
+
+void check_wildcards()
+{
+    CHECK(match("*", ""));
+    CHECK(match("*", "anything"));
+    CHECK(match("", ""));
+    CHECK(!match("", "a"));
+    CHECK(match("inter*tion", "interaction"));
+    CHECK(match("inter*tion", "intertion"));
+    CHECK(!match("inter*tion", "interactions"));
+    CHECK(match("*a*b*", "xxaxxbxx"));
+    CHECK(!match("*a*b*", "xxbxxaxx"));
+    CHECK(match("a*a*a", "aaa"));
+    CHECK(!match("a*a*a", "aa"));
+    CHECK(match("*ab?", "abab!"));
+    CHECK(!match("b??e", "bade!"));
+    CHECK(match("b??e", "bade"));
+}
+
+void check_escapes()
+{
+    CHECK(match("a\\*b", "a*b"));
+    CHECK(!match("a\\*b", "axb"));
+    CHECK(match("a\\?", "a?"));
+    CHECK(!match("a\\?", "ab"));
+    CHECK(match("a\\\\b", "a\\b"));
+    CHECK(match("\\a", "a"));
+    // a backslash at the end is dropped.
+    CHECK(match("ab\\", "ab"));
+    CHECK(!match("ab\\", "ab\\"));
+}
+
+void check_case()
+{
+    CHECK(match("Inter*", "interaction"));
+    CHECK(match("inter*", "INTERACTION"));
+    CHECK(match("*TION", "interaction"));
+    CHECK(match("?A?", "bab"));
+    // ASCII letters only, as std::regex::icase in the C locale.
+    CHECK(!match("\xc3\xa9t\xc3\xa9", "\xc3\x89t\xc3\x89"));
+    CHECK(match("\xc3\xa9t\xc3\xa9", "\xc3\xa9T\xc3\xa9"));
+}
+
+void check_utf8()
+{
+    // '?' is one character, whatever the number of its bytes.
+    CHECK(match("caf?", "caf\xc3\xa9"));
+    CHECK(!match("caf??", "caf\xc3\xa9"));
+    CHECK(match("?", "\xe4\xb8\xad"));
+    CHECK(match("?\xe6\x96\x87", "\xe4\xb8\xad\xe6\x96\x87"));
+    CHECK(match("*?\xe6\x96\x87", "\xe4\xb8\xad\xe6\x96\x87"));
+    CHECK(match("*??", "\xe4\xb8\xad\xe6\x96\x87"));
+    CHECK(!match("*???", "\xe4\xb8\xad\xe6\x96\x87"));
+    CHECK(match("\xe4\xb8\xad*", "\xe4\xb8\xad\xe6\x96\x87"));
+}
+
+void check_prefix()
+{
+    CHECK(GlobPattern("inter*tion").prefix() == "inter");
+    CHECK(GlobPattern("Ba?e*").prefix() == "Ba");
+    CHECK(GlobPattern("*ly").prefix() == "");
+    CHECK(GlobPattern("?a").prefix() == "");
+    CHECK(GlobPattern("plain").prefix() == "plain");
+    CHECK(GlobPattern("a\\*b*").prefix() == "a*b");
+    CHECK(GlobPattern("a\\?b?").prefix() == "a?b");
+    CHECK(GlobPattern("").prefix() == "");
+}
+
+} // namespace
+
+int main()
+{
+    check_like_regex();
+    check_wildcards();
+    check_escapes();
+    check_case();
+    check_utf8();
+    check_prefix();
+    return check::exit_code();
+}
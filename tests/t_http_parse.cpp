@@ -0,0 +1,229 @@
+/*
+ * The hand-written request parsers of httplib::detail against the regexes
+ * they replaced, on good lines and on every one-byte change and truncation
+ * of them, then the framing of the event loop on partial, pipelined and
+ * malformed input.
+ */
+
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "httplib.h"
+
+using namespace httplib;
+
+namespace
+{
+
+const char *const request_lines[] = {
+    "GET /neigh?w=inter&off=-2&len=10 HTTP/1.1\r\n",
+    "GET /?w=%E4%BD%A0%E5%A5%BD&co=1 HTTP/1.1\r\n",
+    "GET / HTTP/1.0\r\n",
+    "HEAD /neigh?w=a+b HTTP/1.1\r\n",
+    "POST /form HTTP/1.1\r\n",
+    "GET /? HTTP/1.1\r\n",
+    "GET ?w=x HTTP/1.1\r\n",
+    "GET /a b HTTP/1.1\r\n",
+    "GET /a?b?c HTTP/1.1\r\n",
+    "PUT / HTTP/1.1\r\n",
+    "GET / HTTP/2.0\r\n",
+    "GET / HTTP/1.1\n",
+    "GET HTTP/1.1\r\n",
+    "",
+};
+
+const char *const header_lines[] = {
+    "Host: 127.0.0.1:8888\r\n",
+    "Accept: */*\r\n",
+    "Referer: http://127.0.0.1:8888/?w=inter\r\n",
+    "Key:value\r\n",
+    "Key: \t value \t \r\n",
+    "Key:: value\r\n",
+    "no colon\r\n",
+    ": empty key\r\n",
+    "Empty:   \r\n",
+    "Key: value\n",
+    "",
+};
+
+// the bytes the changes are made of.
+const char changes[] = " ?:\t\rx1";
+
+struct Parsed {
+    std::string method, path, version;
+    Params params;
+    bool operator==(const Parsed &o) const
+    {
+        return method == o.method && path == o.path && version == o.version && params == o.params;
+    }
+};
+
+// Server::parse_request_line before the hand-written parser.
+bool regex_request_line(const std::string &s, Parsed &p)
+{
+    static const std::regex re("(GET|HEAD|POST) ([^?]+)(?:\\?(.+?))? (HTTP/1\\.[01])\r\n");
+
+    std::smatch m;
+    if (!std::regex_match(s, m, re))
+        return false;
+    p.version = m[4];
+    p.method = m[1];
+    p.path = detail::decode_url(m[2]);
+    if (m[3].length() > 0)
+        detail::parse_query_text(m[3], p.params);
+    return true;
+}
+
+bool plain_request_line(const std::string &s, Parsed &p)
+{
+    detail::request_line rl;
+    if (!detail::parse_request_line(s.data(), s.data() + s.size(), rl))
+        return false;
+    p.version = rl.version.str();
+    p.method = rl.method.str();
+    p.path = detail::decode_url(rl.path.b, rl.path.e);
+    if (!rl.query.empty())
+        detail::parse_query_text(rl.query.b, rl.query.e, p.params);
+    return true;
+}
+
+// read_headers before the hand-written parser.
+bool regex_header(const std::string &s, std::string &key, std::string &val)
+{
+    static const std::regex re(R"((.+?):\s*(.+?)\s*\r\n)");
+
+    std::smatch m;
+    if (!std::regex_match(s, m, re))
+        return false;
+    key = m[1];
+    val = m[2];
+    return true;
+}
+
+bool plain_header(const std::string &s, std::string &key, std::string &val)
+{
+    detail::string_ref k, v;
+    if (!detail::parse_header(s.data(), s.data() + s.size(), k, v))
+        return false;
+    key = k.str();
+    val = v.str();
+    return true;
+}
+
+// line and what it turns into with one byte changed, added or dropped,
+// or cut short; a line ends at its first '\n', as the line reader gives them.
+std::vector<std::string> variants(const std::string &line)
+{
+    std::vector<std::string> res{line};
+    for (size_t i = 0; i <= line.size(); ++i) {
+        res.push_back(line.substr(0, i));
+        if (i < line.size())
+            res.push_back(line.substr(0, i) + line.substr(i + 1));
+        for (const char *c = changes; *c; ++c) {
+            res.push_back(line.substr(0, i) + *c + line.substr(i));
+            if (i < line.size())
+                res.push_back(line.substr(0, i) + *c + line.substr(i + 1));
+        }
+    }
+    std::vector<std::string> lines;
+    for (const auto &s : res) {
+        const size_t nl = s.find('\n');
+        if (nl == std::string::npos || nl + 1 == s.size())
+            lines.push_back(s);
+    }
+    return lines;
+}
+
+void check_request_lines()
+{
+    for (const char *line : request_lines) {
+        for (const auto &s : variants(line)) {
+            Parsed a, b;
+            const bool ra = regex_request_line(s, a), rb = plain_request_line(s, b);
+            if (ra != rb || !(a == b)) {
+                printf("request line '%s': regex %d, parser %d\n", s.c_str(), ra, rb);
+                CHECK(false);
+            }
+        }
+    }
+    Parsed p;
+    CHECK(plain_request_line("GET /neigh?w=a+b&len=3 HTTP/1.0\r\n", p));
+    CHECK(p.method == "GET" && p.path == "/neigh" && p.version == "HTTP/1.0");
+    CHECK(p.params.size() == 2 && p.params.find("len")->second == "3");
+}
+
+void check_headers()
+{
+    for (const char *line : header_lines) {
+        for (const auto &s : variants(line)) {
+            std::string ka, va, kb, vb;
+            bool ra = regex_header(s, ka, va);
+            const bool rb = plain_header(s, kb, vb);
+            // values of white space only are skipped now, the regex kept one byte of them.
+            if (ra && va.find_first_not_of(" \t\r\f\v") == std::string::npos) {
+                ra = false;
+                ka = va = "";
+            }
+            if (ra != rb || ka != kb || va != vb) {
+                printf("header '%s': regex %d '%s' '%s', parser %d '%s' '%s'\n", s.c_str(), ra, ka.c_str(),
+                       va.c_str(), rb, kb.c_str(), vb.c_str());
+                CHECK(false);
+            }
+        }
+    }
+    std::string key, val;
+    CHECK(plain_header("Key: \t value \t \r\n", key, val) && key == "Key" && val == "value");
+    CHECK(!plain_header("Empty: \t \r\n", key, val));
+    CHECK(!plain_header("Empty:\r\n", key, val));
+}
+
+#ifdef __linux__
+void check_request_length()
+{
+    using detail::request_length;
+
+    const std::string get = "GET / HTTP/1.1\r\nHost: x\r\n\r\n";
+    const std::string post = "POST /form HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello";
+
+    // not there yet, whatever the place it is cut at.
+    for (size_t i = 0; i < get.size(); ++i)
+        CHECK(request_length(get.substr(0, i)) == 0);
+    for (size_t i = 0; i < post.size(); ++i)
+        CHECK(request_length(post.substr(0, i)) == 0);
+    CHECK(request_length(get) == long(get.size()));
+    CHECK(request_length(post) == long(post.size()));
+
+    // pipelined: the first request only, the rest stays for the next call.
+    CHECK(request_length(get + get) == long(get.size()));
+    CHECK(request_length(post + get) == long(post.size()));
+    CHECK(request_length(get + post.substr(0, 10)) == long(get.size()));
+    CHECK(request_length(post + "GET") == long(post.size()));
+    // the headers of the next request do not count for this one.
+    CHECK(request_length(get + "POST / HTTP/1.1\r\nContent-Length: 99\r\n\r\n") == long(get.size()));
+
+    CHECK(request_length("GET / HTTP/1.1\r\ncontent-length: 2\r\n\r\nab") == 39);
+    CHECK(request_length("GET / HTTP/1.1\r\nContent-Length: junk\r\n\r\nab") == 40);
+    CHECK(request_length("GET / HTTP/1.1\r\nX-Content-Length: 2\r\n\r\n") == 39);
+    CHECK(request_length("\r\n\r\n") == 4);
+
+    // can not be framed.
+    CHECK(request_length("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n0\r\n\r\n") == -1);
+    CHECK(request_length("POST / HTTP/1.1\r\nContent-Length: 99999999\r\n\r\n") == -1);
+    CHECK(request_length(std::string(CPPHTTPLIB_EVENT_LOOP_MAX_REQUEST_SIZE, 'x')) == 0);
+    CHECK(request_length(std::string(CPPHTTPLIB_EVENT_LOOP_MAX_REQUEST_SIZE + 1, 'x')) == -1);
+}
+#endif
+
+} // namespace
+
+int main()
+{
+    check_request_lines();
+    check_headers();
+#ifdef __linux__
+    check_request_length();
+#endif
+    return check::exit_code();
+}
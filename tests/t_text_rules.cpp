@@ -0,0 +1,141 @@
+/*
+ * The plain text rules of a format file, which TransformatTemplate puts
+ * together in Aho-Corasick passes, against the same rules applied one by
+ * one the way TransActText does, on random rules and texts over a small
+ * alphabet so that they run into each other often. Also the matches the
+ * automaton reports against a naive search.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "aho_corasick.hpp"
+#include "check.hpp"
+#include "libwrapper.hpp"
+
+namespace
+{
+
+std::string random_text(std::mt19937 &rng, size_t min_len, size_t max_len, const char *alphabet = "abc")
+{
+    const size_t n = strlen(alphabet);
+    std::string s;
+    for (size_t len = min_len + rng() % (max_len - min_len + 1); len > 0; --len)
+        s += alphabet[rng() % n];
+    return s;
+}
+
+// every distinct pattern ending at each place of the text, the first
+// added of each, as match() and shorter() give them.
+void check_matches(std::mt19937 &rng)
+{
+    for (int round = 0; round < 500; ++round) {
+        std::vector<std::string> patterns;
+        AhoCorasick automaton;
+        for (size_t n = 1 + rng() % 8; n > 0; --n) {
+            patterns.push_back(random_text(rng, 1, 4));
+            automaton.add(patterns.back());
+        }
+        automaton.build();
+        const std::string text = random_text(rng, 0, 40);
+        int state = AhoCorasick::start();
+        for (size_t i = 0; i < text.size(); ++i) {
+            state = automaton.next(state, text[i]);
+            std::set<int> got, want;
+            for (int id = automaton.match(state); id >= 0; id = automaton.shorter(id))
+                CHECK(got.insert(id).second);
+            std::set<std::string> seen;
+            for (size_t id = 0; id < patterns.size(); ++id) {
+                const std::string &p = patterns[id];
+                if (p.size() <= i + 1 && text.compare(i + 1 - p.size(), p.size(), p) == 0 && seen.insert(p).second)
+                    want.insert(id);
+            }
+            CHECK(got == want);
+        }
+    }
+}
+
+// the rules one by one, as TransActText::replaceAll() applies each.
+std::string apply_one_by_one(const std::vector<std::pair<std::string, std::string>> &rules, std::string s)
+{
+    for (const auto &rule : rules) {
+        for (std::string::size_type pos = 0; (pos = s.find(rule.first, pos)) != std::string::npos;) {
+            s.replace(pos, rule.first.size(), rule.second);
+            pos += rule.second.size();
+        }
+    }
+    return s;
+}
+
+void check_rules(std::mt19937 &rng)
+{
+    std::map<std::string, std::string> books;
+    books["test"] = "/tmp";
+    const CBook_it book = books.begin();
+    // the rules that overlap are reported on stderr, which would be most of them.
+    if (!freopen("/dev/null", "w", stderr))
+        perror("freopen");
+
+    for (int round = 0; round < 2000; ++round) {
+        std::vector<std::pair<std::string, std::string>> rules;
+        std::string conf = ":m\n";
+        for (size_t n = 1 + rng() % 6; n > 0; --n) {
+            rules.emplace_back(random_text(rng, 1, 3), random_text(rng, 0, 3));
+            conf += rules.back().first + "=" + rules.back().second + "\n";
+        }
+        char name[] = "/tmp/t_text_rules_XXXXXX";
+        const int fd = mkstemp(name);
+        if (fd < 0 || write(fd, conf.data(), conf.size()) != ssize_t(conf.size())) {
+            perror(name);
+            CHECK(false);
+            return;
+        }
+        close(fd);
+        const TransformatTemplate tt(name, books);
+        unlink(name);
+
+        for (int i = 0; i < 20; ++i) {
+            const std::string text = random_text(rng, 0, 30);
+            const std::string want = apply_one_by_one(rules, text);
+            const std::string got = tt.generate(book, text.data(), text.size(), 'm');
+            if (got != want) {
+                printf("rules:\n%s'%s' gives '%s', one by one '%s'\n", conf.c_str(), text.c_str(), got.c_str(),
+                       want.c_str());
+                CHECK(false);
+            }
+        }
+    }
+}
+
+void check_conflicts()
+{
+    std::string with;
+    TransActTextSet set;
+    set.add("ab", "x");
+    CHECK(set.conflict("cd", &with) == TransActTextSet::cfNONE);
+    CHECK(set.conflict("bc", &with) == TransActTextSet::cfOVERLAP && with == "ab");
+    CHECK(set.conflict("ca", &with) == TransActTextSet::cfOVERLAP);
+    CHECK(set.conflict("b", &with) == TransActTextSet::cfOVERLAP);
+    CHECK(set.conflict("xab", &with) == TransActTextSet::cfOVERLAP);
+    CHECK(set.conflict("yx", &with) == TransActTextSet::cfOVERLAP);
+    set.add("c", "");
+    CHECK(set.conflict("d", &with) == TransActTextSet::cfNONE);
+    CHECK(set.conflict("de", &with) == TransActTextSet::cfJOIN && with == "c");
+}
+
+} // namespace
+
+int main()
+{
+    std::mt19937 rng(42);
+    check_matches(rng);
+    check_conflicts();
+    check_rules(rng);
+    return check::exit_code();
+}
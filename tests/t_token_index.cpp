@@ -0,0 +1,143 @@
+/*
+ * TokenIndex::candidates() against the entries SearchData finds, looking
+ * with a TermMatcher in each field: whenever the index narrows the
+ * entries, every entry holding all the words must be among them. The
+ * entries are made of a vocabulary of a few very common words and many
+ * rare ones, joined with spaces, punctuation and UTF-8 text; the queries
+ * are words, pieces of words and runs across them.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "check.hpp"
+#include "term_matcher.hpp"
+#include "token_index.hpp"
+
+namespace
+{
+
+const char *const vocabulary[] = {
+    "the", "of", "a", "to", "state", "water", "genus", "plant", "river", "music", "church", "iron",
+    "ornithological", "cartographic", "polyphonic", "metallurgy", "caf\xc3\xa9", "na\xc3\xafve",
+    "\xe4\xb8\xad\xe6\x96\x87", "x2", "42",
+};
+const size_t nvocabulary = sizeof(vocabulary) / sizeof(vocabulary[0]);
+
+const char *const separators[] = {" ", " ", " ", ", ", "-", ".", "\n", "(", ") ", "'"};
+const size_t nseparators = sizeof(separators) / sizeof(separators[0]);
+
+typedef std::vector<std::string> Entry; // its fields
+
+// the word of rank r comes up about as often as 1 / (r + 1).
+const char *random_word(std::mt19937 &rng)
+{
+    const size_t r = std::min<size_t>(nvocabulary - 1, size_t(std::exponential_distribution<>(0.25)(rng)));
+    return vocabulary[r];
+}
+
+std::vector<Entry> make_entries(std::mt19937 &rng, size_t n)
+{
+    std::vector<Entry> entries(n);
+    for (auto &fields : entries) {
+        for (size_t f = 1 + rng() % 3; f > 0; --f) {
+            std::string text;
+            for (size_t w = rng() % 8; w > 0; --w) {
+                text += random_word(rng);
+                text += separators[rng() % nseparators];
+            }
+            fields.push_back(text);
+        }
+    }
+    return entries;
+}
+
+// a word of the vocabulary, a piece of one, or a run across two.
+std::string random_query_word(std::mt19937 &rng)
+{
+    const std::string w = random_word(rng);
+    switch (rng() % 4) {
+    case 0:
+        return w;
+    case 1: {
+        const size_t b = rng() % w.size();
+        return w.substr(b, 1 + rng() % (w.size() - b));
+    }
+    case 2:
+        return w + separators[rng() % nseparators] + random_word(rng);
+    default:
+        return w.substr(w.size() / 2) + separators[rng() % nseparators] + random_word(rng);
+    }
+}
+
+bool search_data(TermMatcher &matcher, const Entry &fields)
+{
+    matcher.reset();
+    for (const auto &text : fields)
+        if (matcher.find(text.data(), text.size()))
+            return true;
+    return false;
+}
+
+} // namespace
+
+int main()
+{
+    std::mt19937 rng(42);
+    const std::vector<Entry> entries = make_entries(rng, 3000);
+    TokenIndex::Builder builder;
+    for (size_t i = 0; i < entries.size(); ++i)
+        for (const auto &text : entries[i])
+            builder.add(i, text.data(), text.size());
+
+    char name[] = "/tmp/t_token_index_XXXXXX";
+    const int fd = mkstemp(name);
+    if (fd < 0) {
+        perror(name);
+        return EXIT_FAILURE;
+    }
+    close(fd);
+    TokenIndex index;
+    const bool loaded = builder.save(name, entries.size()) && index.load(name, entries.size(), 0);
+    unlink(name);
+    CHECK(loaded);
+    if (!loaded)
+        return check::exit_code();
+
+    size_t narrowed = 0;
+    for (int q = 0; q < 3000; ++q) {
+        std::vector<std::string> words;
+        for (size_t n = 1 + rng() % 3; n > 0; --n)
+            words.push_back(random_query_word(rng));
+        std::vector<uint32_t> res;
+        if (!index.candidates(words, res))
+            continue;
+        ++narrowed;
+        CHECK(std::is_sorted(res.begin(), res.end()));
+        CHECK(std::adjacent_find(res.begin(), res.end()) == res.end());
+        TermMatcher matcher(words);
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (search_data(matcher, entries[i]) && !std::binary_search(res.begin(), res.end(), uint32_t(i))) {
+                printf("entry %zu holds", i);
+                for (const auto &w : words)
+                    printf(" '%s'", w.c_str());
+                printf(" but is not a candidate\n");
+                CHECK(false);
+            }
+        }
+    }
+    // most queries have a rare run.
+    CHECK(narrowed > 1000);
+
+    // a word in most entries does not narrow them, a rare one does.
+    std::vector<uint32_t> res;
+    CHECK(!index.candidates({"the"}, res));
+    CHECK(index.candidates({"the", "metallurgy"}, res) && res.size() < entries.size() / TokenIndex::MAX_SHARE);
+    CHECK(index.candidates({"zyzzyva"}, res) && res.empty());
+    CHECK(!index.candidates({"", " - "}, res));
+    return check::exit_code();
+}
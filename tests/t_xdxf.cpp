@@ -0,0 +1,117 @@
+/*
+ * The built-in XDXF converter (":x native" followed by the
+ * /usr/share/stardict/dic= rule) against the :x rules of dist/format.conf,
+ * on entries with every tag the rules know, cut and nested in odd ways,
+ * and on random strings of tag and text pieces.
+ */
+
+#include <cstdio>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "check.hpp"
+#include "libwrapper.hpp"
+
+namespace
+{
+
+const char *const entries[] = {
+    "",
+    "plain text",
+    "<k>word</k>\n<tr>trans</tr>",
+    "<abr>n.</abr> <ex>an example</ex>",
+    "<c>grey</c> <c c=\"red\">red</c> <c c='blue'>blue</c>",
+    "see <kref>word</kref>, <kref>other word</kref>",
+    "<kref k=\"key\">shown</kref>",
+    "<kref><b>bold</b></kref>",
+    "<kref></kref>",
+    "<kref>two\nlines</kref>",
+    "<kref>unclosed",
+    "closed</kref>",
+    "<kref>a<kref>b</kref></kref>",
+    "<kref>a</k>b</k></kref>",
+    "<kref></k><k></kref>",
+    "<rref>a.wav</rref>",
+    "<rref>snd/a.wav</rref>",
+    "<rref>a.b.wav</rref>",
+    "<rref>.wav</rref>",
+    "<rref>a.WAV</rref>",
+    "<rref>a.png</rref>",
+    "<rref></rref>",
+    "<rref>a.wav</rref><rref>b.png</rref><rref>c.wav</rref>",
+    "<rref>a.wav",
+    "<rref>a</k>.wav</rref>",
+    "<rref></k>.wav</rref>",
+    "<rref></k/.wav</rref>",
+    "a path /usr/share/stardict/dic/x in the text",
+    "<rref>/usr/share/stardict/dic/a.png</rref>",
+    "< not a tag <<k>> <K>upper</K> <kreff>",
+    "<ex><kref>in</kref> <c c=\"red\">an <abr>ex</abr></c></ex>",
+    "<k>unclosed <tr>",
+    "</k></abr></tr></ex></c></rref>",
+    "<",
+    "<k",
+    "<kref",
+    "<rref",
+};
+
+// what the random entries are made of.
+const char *const pieces[] = {
+    "<k>", "</k>", "<abr>", "</abr>", "<tr>", "</tr>", "<ex>", "</ex>", "<c>", "<c c=\"red\">", "<c c=", "</c>",
+    "<kref>", "<kref k=\"", "\">", "</kref>", "<rref>", "</rref>", ".wav", ".png", ".", "/", "<b>", "</b>", "<",
+    ">", "\"", "'", "a", "bc", " ", "\n", "/usr/share/stardict/dic", "/usr/share/stardict/dic/test", "\xc3\xa9",
+};
+
+std::string write_native_conf()
+{
+    char name[] = "/tmp/t_xdxf_XXXXXX";
+    const int fd = mkstemp(name);
+    static const char conf[] = ":x native\n/usr/share/stardict/dic=\n";
+    if (fd < 0 || write(fd, conf, sizeof(conf) - 1) != sizeof(conf) - 1) {
+        perror(name);
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+    return name;
+}
+
+void check_entry(const TransformatTemplate &rules, const TransformatTemplate &native, const CBook_it &book,
+                 const std::string &entry)
+{
+    const std::string a = rules.generate(book, entry.data(), entry.size(), 'x');
+    const std::string b = native.generate(book, entry.data(), entry.size(), 'x');
+    if (a != b) {
+        printf("%s with %s:\n%s\nrules:\n%s\nnative:\n%s\n", book->first.c_str(), book->second.c_str(),
+               entry.c_str(), a.c_str(), b.c_str());
+        CHECK(false);
+    }
+}
+
+} // namespace
+
+int main()
+{
+    std::map<std::string, std::string> books;
+    // {{DICT_PATH}} is cut by the /usr/share/stardict/dic= rule, or not.
+    books["installed"] = "/usr/share/stardict/dic/test";
+    books["home"] = "/home/user/dicts/test";
+    const std::string native_conf = write_native_conf();
+    const TransformatTemplate rules(FORMAT_CONF, books), native(native_conf.c_str(), books);
+    unlink(native_conf.c_str());
+
+    std::mt19937 rng(42);
+    const size_t npieces = sizeof(pieces) / sizeof(pieces[0]);
+    for (auto book = books.cbegin(); book != books.cend(); ++book) {
+        for (const char *entry : entries)
+            check_entry(rules, native, book, entry);
+        for (int i = 0; i < 20000; ++i) {
+            std::string entry;
+            for (int n = rng() % 12; n > 0; --n)
+                entry += pieces[rng() % npieces];
+            check_entry(rules, native, book, entry);
+        }
+    }
+    return check::exit_code();
+}